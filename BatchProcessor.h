@@ -0,0 +1,198 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+// One record of a capture file: a 32 bit clock and a 16 bit data length, both
+// low byte first, followed by the data. data points into the capture buffer.
+struct BatchRecord
+{
+    uint32_t clock;
+    const uint8_t* data;
+    size_t size;
+};
+
+static const size_t BATCH_RECORD_HEADER_SIZE = 6;
+
+// Splits a capture buffer into records. Returns false when the last record is
+// truncated, the records before it are still returned.
+inline bool ParseBatchRecords(const uint8_t* data, size_t size, std::vector<BatchRecord>& records)
+{
+    records.clear();
+    size_t offset = 0;
+    while (offset + BATCH_RECORD_HEADER_SIZE <= size)
+    {
+        BatchRecord record;
+        record.clock = data[offset] | data[offset + 1] << 8 | data[offset + 2] << 16 | static_cast<uint32_t>(data[offset + 3]) << 24;
+        record.size = data[offset + 4] | data[offset + 5] << 8;
+        record.data = data + offset + BATCH_RECORD_HEADER_SIZE;
+        if (offset + BATCH_RECORD_HEADER_SIZE + record.size > size)
+        {
+            return false;
+        }
+        records.push_back(record);
+        offset += BATCH_RECORD_HEADER_SIZE + record.size;
+    }
+    return offset == size;
+}
+
+// Appends a record in the capture format, so batch output can be fed back in.
+inline void AppendBatchRecord(std::vector<uint8_t>& out, uint32_t clock, const uint8_t* data, size_t size)
+{
+    const uint8_t header[BATCH_RECORD_HEADER_SIZE] =
+    {
+        static_cast<uint8_t>(clock & 0xFF),
+        static_cast<uint8_t>((clock >> 8) & 0xFF),
+        static_cast<uint8_t>((clock >> 16) & 0xFF),
+        static_cast<uint8_t>((clock >> 24) & 0xFF),
+        static_cast<uint8_t>(size & 0xFF),
+        static_cast<uint8_t>((size >> 8) & 0xFF),
+    };
+    out.insert(out.end(), header, header + BATCH_RECORD_HEADER_SIZE);
+    out.insert(out.end(), data, data + size);
+}
+
+// Runs records through a pool of threads with work stealing. Records are cut
+// into chunks and every worker starts with an even, contiguous share of them.
+// A worker takes chunks from the front of its own share and, once that is
+// empty, steals the back half of another worker's share. A share is one
+// 64 bit atomic holding [begin, end), so taking and stealing are both a single
+// compare exchange and no locks are held.
+//
+// Every worker gets its own Context from makeContext, none of the whitening,
+// HEC, CRC or decoder state is shared. Each chunk writes to its own output
+// buffer and the buffers are joined in chunk order, so the output is the same
+// whatever the thread count or stealing order.
+class BatchProcessor
+{
+public:
+    static const size_t DEFAULT_CHUNK_RECORDS = 256;
+
+    BatchProcessor(uint32_t threadCount = 0, size_t chunkRecords = DEFAULT_CHUNK_RECORDS)
+    {
+        m_threadCount = threadCount != 0 ? threadCount : std::thread::hardware_concurrency();
+        m_threadCount = m_threadCount != 0 ? m_threadCount : 1;
+        m_chunkRecords = chunkRecords != 0 ? chunkRecords : DEFAULT_CHUNK_RECORDS;
+    }
+
+    uint32_t GetThreadCount() const { return m_threadCount; }
+
+    // process(context, record, out) appends the output of one record to out
+    template <typename MakeContext, typename Process>
+    void Run(const std::vector<BatchRecord>& records, std::vector<uint8_t>& output, MakeContext makeContext, Process process)
+    {
+        const size_t chunkCount = (records.size() + m_chunkRecords - 1) / m_chunkRecords;
+        const uint32_t workerCount = static_cast<uint32_t>(chunkCount < m_threadCount ? (chunkCount != 0 ? chunkCount : 1) : m_threadCount);
+        std::vector<std::vector<uint8_t>> chunkOutputs(chunkCount);
+        std::vector<WorkShare> shares(workerCount);
+        for (uint32_t worker = 0; worker < workerCount; worker++)
+        {
+            shares[worker].range.store(PackRange(chunkCount * worker / workerCount, chunkCount * (worker + 1) / workerCount));
+        }
+
+        auto workerLoop = [&](uint32_t worker)
+        {
+            auto context = makeContext();
+            size_t chunk = NO_CHUNK;
+            while (TakeChunk(shares, worker, chunk) || StealChunks(shares, worker))
+            {
+                if (chunk == NO_CHUNK)
+                {
+                    continue;
+                }
+                std::vector<uint8_t>& chunkOutput = chunkOutputs[chunk];
+                const size_t last = (chunk + 1) * m_chunkRecords < records.size() ? (chunk + 1) * m_chunkRecords : records.size();
+                for (size_t record = chunk * m_chunkRecords; record < last; record++)
+                {
+                    process(context, records[record], chunkOutput);
+                }
+                chunk = NO_CHUNK;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (uint32_t worker = 1; worker < workerCount; worker++)
+        {
+            threads.emplace_back(workerLoop, worker);
+        }
+        workerLoop(0);
+        for (size_t i = 0; i < threads.size(); i++)
+        {
+            threads[i].join();
+        }
+
+        size_t outputSize = 0;
+        for (size_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            outputSize += chunkOutputs[chunk].size();
+        }
+        output.clear();
+        output.reserve(outputSize);
+        for (size_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            output.insert(output.end(), chunkOutputs[chunk].begin(), chunkOutputs[chunk].end());
+        }
+    }
+
+private:
+    static const size_t NO_CHUNK = ~static_cast<size_t>(0);
+
+    // own cache line each, workers hammer their own share
+    struct alignas(64) WorkShare
+    {
+        std::atomic<uint64_t> range;
+    };
+
+    static uint64_t PackRange(size_t begin, size_t end)
+    {
+        return static_cast<uint64_t>(begin) | static_cast<uint64_t>(end) << 32;
+    }
+
+    static size_t RangeBegin(uint64_t range) { return static_cast<size_t>(range & 0xFFFFFFFF); }
+    static size_t RangeEnd(uint64_t range) { return static_cast<size_t>(range >> 32); }
+
+    // the front chunk of the worker's own share
+    static bool TakeChunk(std::vector<WorkShare>& shares, uint32_t worker, size_t& chunk)
+    {
+        uint64_t range = shares[worker].range.load();
+        while (RangeBegin(range) < RangeEnd(range))
+        {
+            if (shares[worker].range.compare_exchange_weak(range, PackRange(RangeBegin(range) + 1, RangeEnd(range))))
+            {
+                chunk = RangeBegin(range);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Moves the back half of the first non empty share found into the
+    // worker's own, which is empty so no other thread writes to it. Returns
+    // false when every share was empty.
+    static bool StealChunks(std::vector<WorkShare>& shares, uint32_t worker)
+    {
+        const uint32_t workerCount = static_cast<uint32_t>(shares.size());
+        for (uint32_t step = 1; step < workerCount; step++)
+        {
+            WorkShare& victim = shares[(worker + step) % workerCount];
+            uint64_t range = victim.range.load();
+            while (RangeBegin(range) < RangeEnd(range))
+            {
+                size_t begin = RangeBegin(range);
+                size_t end = RangeEnd(range);
+                size_t split = end - (end - begin + 1) / 2;
+                if (victim.range.compare_exchange_weak(range, PackRange(begin, split)))
+                {
+                    shares[worker].range.store(PackRange(split, end));
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    uint32_t m_threadCount;
+    size_t m_chunkRecords;
+};
@@ -0,0 +1,338 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "LinearFeedbackShiftRegister.h"
+
+// carry-less multiply kernels, picked at runtime from the CPU features
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BLUETOOTH_CRC_CLMUL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BLUETOOTH_CRC_CLMUL_TARGET
+#else
+#define BLUETOOTH_CRC_CLMUL_TARGET __attribute__((target("pclmul,sse2")))
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#define BLUETOOTH_CRC_CLMUL_ARM
+#include <arm_neon.h>
+#define BLUETOOTH_CRC_CLMUL_TARGET
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+enum class CrcKernel
+{
+    Table,      // slicing by 8
+    ClMul,      // PCLMULQDQ / PMULL folding, then the table for the last 16 bytes
+};
+
+// Table driven CRC-16 for the payload CRC, poly 0x11021, slicing by 8.
+// Values use the same bit order as LinearFeedbackShiftRegister::GetState for the
+// bit serial CRC register, register 0 in bit 15. In that order the register
+// shifts right and data bits enter at bit 0 first, so this is the reflected
+// form of the CRC with poly 0x8408 and each byte is consumed in one lookup.
+class BluetoothCrc16
+{
+public:
+    static const BluetoothCrc16& Get()
+    {
+        static const BluetoothCrc16 crc16;
+        return crc16;
+    }
+
+    // the register loaded with the UAP, in GetState order
+    static uint16_t Seed(uint8_t uap)
+    {
+        uint16_t seed = 0;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            seed |= ((uap >> i) & 1) << (15 - i);
+        }
+        return seed;
+    }
+
+    // payloads from this size on go through the carry-less multiply kernel
+    static const size_t CLMUL_MIN_SIZE = 128;
+
+    uint16_t Calc(uint8_t uap, const uint8_t* data, size_t size) const
+    {
+        return Update(Seed(uap), data, size);
+    }
+
+    // continues a CRC over more data with the fastest kernel for the size
+    uint16_t Update(uint16_t crc, const uint8_t* data, size_t size) const
+    {
+        if (m_hasClMul && size >= CLMUL_MIN_SIZE)
+        {
+            return UpdateClMul(crc, data, size);
+        }
+        return UpdateTable(crc, data, size);
+    }
+
+    bool HasClMul() const { return m_hasClMul; }
+
+    uint16_t Update(CrcKernel kernel, uint16_t crc, const uint8_t* data, size_t size) const
+    {
+        if (kernel == CrcKernel::ClMul && m_hasClMul)
+        {
+            return UpdateClMul(crc, data, size);
+        }
+        return UpdateTable(crc, data, size);
+    }
+
+    // Folds 16 byte blocks with carry-less multiplies until under 16 bytes
+    // remain unfolded, then finishes the folded block and the tail with the table.
+    uint16_t UpdateClMul(uint16_t crc, const uint8_t* data, size_t size) const
+    {
+        if (size < 16)
+        {
+            return UpdateTable(crc, data, size);
+        }
+        uint8_t folded[16];
+        size_t foldedSize = FoldClMul(crc, data, size, m_foldConstants, folded);
+        crc = UpdateTable(0, folded, sizeof(folded));
+        return UpdateTable(crc, data + foldedSize, size - foldedSize);
+    }
+
+    // continues a CRC over more data, 8 bytes per step through 8 tables
+    uint16_t UpdateTable(uint16_t crc, const uint8_t* data, size_t size) const
+    {
+        uint32_t crcVal = crc;
+        for (; size >= 8; size -= 8, data += 8)
+        {
+            uint32_t low = (data[0] | data[1] << 8) ^ crcVal;
+            crcVal = m_table[7][low & 0xFF] ^
+                     m_table[6][low >> 8] ^
+                     m_table[5][data[2]] ^
+                     m_table[4][data[3]] ^
+                     m_table[3][data[4]] ^
+                     m_table[2][data[5]] ^
+                     m_table[1][data[6]] ^
+                     m_table[0][data[7]];
+        }
+        for (; size > 0; size--, data++)
+        {
+            crcVal = (crcVal >> 8) ^ m_table[0][(crcVal ^ *data) & 0xFF];
+        }
+        return static_cast<uint16_t>(crcVal);
+    }
+
+private:
+    BluetoothCrc16()
+    {
+        // A 16 byte block loaded little endian is the message polynomial with its
+        // first bit as the x^127 term, the bit order carry-less multiplies need for
+        // a reflected CRC. Folding a block forward by n bits multiplies its high
+        // and low 64 bit halves by x^(n+64) and x^n mod P, each stored one power
+        // lower as the 64 x 64 product lands one bit up in a reflected register.
+        m_foldConstants[0] = ReflectedXPowMod(128 + 64 - 1);
+        m_foldConstants[1] = ReflectedXPowMod(128 - 1);
+        m_foldConstants[2] = ReflectedXPowMod(512 + 64 - 1);
+        m_foldConstants[3] = ReflectedXPowMod(512 - 1);
+        m_hasClMul = DetectClMul();
+
+        for (uint32_t value = 0; value < 256; value++)
+        {
+            uint32_t crcVal = value;
+            for (uint32_t bit = 0; bit < 8; bit++)
+            {
+                crcVal = (crcVal >> 1) ^ ((crcVal & 1) ? 0x8408 : 0);
+            }
+            m_table[0][value] = static_cast<uint16_t>(crcVal);
+        }
+        // table k advances a byte followed by k zero bytes
+        for (uint32_t k = 1; k < 8; k++)
+        {
+            for (uint32_t value = 0; value < 256; value++)
+            {
+                uint16_t prev = m_table[k - 1][value];
+                m_table[k][value] = (prev >> 8) ^ m_table[0][prev & 0xFF];
+            }
+        }
+    }
+
+    // x^n mod 0x11021 with the x^i term in bit 63 - i
+    static uint64_t ReflectedXPowMod(uint32_t n)
+    {
+        uint32_t value = 1;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            value <<= 1;
+            if (value & 0x10000)
+            {
+                value ^= 0x11021;
+            }
+        }
+        uint64_t reflected = 0;
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            reflected |= static_cast<uint64_t>((value >> i) & 1) << (63 - i);
+        }
+        return reflected;
+    }
+
+    static bool DetectClMul()
+    {
+#if defined(BLUETOOTH_CRC_CLMUL_X86)
+#ifdef _MSC_VER
+        int cpuInfo[4];
+        __cpuid(cpuInfo, 1);
+        return (cpuInfo[2] & (1 << 1)) != 0;
+#else
+        return __builtin_cpu_supports("pclmul") != 0;
+#endif
+#elif defined(BLUETOOTH_CRC_CLMUL_ARM)
+#if defined(__linux__) && defined(HWCAP_PMULL)
+        return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#else
+        return true;
+#endif
+#else
+        return false;
+#endif
+    }
+
+#if defined(BLUETOOTH_CRC_CLMUL_X86)
+    static inline BLUETOOTH_CRC_CLMUL_TARGET __m128i Fold(__m128i block, __m128i constants)
+    {
+        return _mm_xor_si128(_mm_clmulepi64_si128(block, constants, 0x00), _mm_clmulepi64_si128(block, constants, 0x11));
+    }
+
+    // folds 4 lanes 64 bytes apart, then the lanes into one, then 16 bytes at a time
+    static BLUETOOTH_CRC_CLMUL_TARGET size_t FoldClMul(uint16_t crc, const uint8_t* data, size_t size, const uint64_t* constants, uint8_t* folded)
+    {
+        const __m128i fold128 = _mm_set_epi64x(static_cast<long long>(constants[1]), static_cast<long long>(constants[0]));
+        const __m128i fold512 = _mm_set_epi64x(static_cast<long long>(constants[3]), static_cast<long long>(constants[2]));
+        size_t offset = 0;
+
+        __m128i lane0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), _mm_cvtsi32_si128(crc));
+        offset += 16;
+        if (size >= 64)
+        {
+            __m128i lane1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+            __m128i lane2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32));
+            __m128i lane3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48));
+            offset = 64;
+            for (; offset + 64 <= size; offset += 64)
+            {
+                lane0 = _mm_xor_si128(Fold(lane0, fold512), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)));
+                lane1 = _mm_xor_si128(Fold(lane1, fold512), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + 16)));
+                lane2 = _mm_xor_si128(Fold(lane2, fold512), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + 32)));
+                lane3 = _mm_xor_si128(Fold(lane3, fold512), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + 48)));
+            }
+            lane0 = _mm_xor_si128(Fold(lane0, fold128), lane1);
+            lane0 = _mm_xor_si128(Fold(lane0, fold128), lane2);
+            lane0 = _mm_xor_si128(Fold(lane0, fold128), lane3);
+        }
+        for (; offset + 16 <= size; offset += 16)
+        {
+            lane0 = _mm_xor_si128(Fold(lane0, fold128), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(folded), lane0);
+        return offset;
+    }
+#elif defined(BLUETOOTH_CRC_CLMUL_ARM)
+    static inline uint64x2_t Fold(uint64x2_t block, const uint64_t* constants)
+    {
+        uint64x2_t high = vreinterpretq_u64_p128(vmull_p64(static_cast<poly64_t>(vgetq_lane_u64(block, 0)), static_cast<poly64_t>(constants[0])));
+        uint64x2_t low = vreinterpretq_u64_p128(vmull_p64(static_cast<poly64_t>(vgetq_lane_u64(block, 1)), static_cast<poly64_t>(constants[1])));
+        return veorq_u64(high, low);
+    }
+
+    // folds 4 lanes 64 bytes apart, then the lanes into one, then 16 bytes at a time
+    static size_t FoldClMul(uint16_t crc, const uint8_t* data, size_t size, const uint64_t* constants, uint8_t* folded)
+    {
+        const uint64_t* fold128 = &constants[0];
+        const uint64_t* fold512 = &constants[2];
+        size_t offset = 0;
+
+        uint64x2_t lane0 = veorq_u64(vld1q_u64(reinterpret_cast<const uint64_t*>(data)), vsetq_lane_u64(crc, vdupq_n_u64(0), 0));
+        offset += 16;
+        if (size >= 64)
+        {
+            uint64x2_t lane1 = vld1q_u64(reinterpret_cast<const uint64_t*>(data + 16));
+            uint64x2_t lane2 = vld1q_u64(reinterpret_cast<const uint64_t*>(data + 32));
+            uint64x2_t lane3 = vld1q_u64(reinterpret_cast<const uint64_t*>(data + 48));
+            offset = 64;
+            for (; offset + 64 <= size; offset += 64)
+            {
+                lane0 = veorq_u64(Fold(lane0, fold512), vld1q_u64(reinterpret_cast<const uint64_t*>(data + offset)));
+                lane1 = veorq_u64(Fold(lane1, fold512), vld1q_u64(reinterpret_cast<const uint64_t*>(data + offset + 16)));
+                lane2 = veorq_u64(Fold(lane2, fold512), vld1q_u64(reinterpret_cast<const uint64_t*>(data + offset + 32)));
+                lane3 = veorq_u64(Fold(lane3, fold512), vld1q_u64(reinterpret_cast<const uint64_t*>(data + offset + 48)));
+            }
+            lane0 = veorq_u64(Fold(lane0, fold128), lane1);
+            lane0 = veorq_u64(Fold(lane0, fold128), lane2);
+            lane0 = veorq_u64(Fold(lane0, fold128), lane3);
+        }
+        for (; offset + 16 <= size; offset += 16)
+        {
+            lane0 = veorq_u64(Fold(lane0, fold128), vld1q_u64(reinterpret_cast<const uint64_t*>(data + offset)));
+        }
+        vst1q_u64(reinterpret_cast<uint64_t*>(folded), lane0);
+        return offset;
+    }
+#else
+    // no carry-less multiply on this target, never selected as m_hasClMul stays false
+    static size_t FoldClMul(uint16_t crc, const uint8_t* data, size_t, const uint64_t*, uint8_t* folded)
+    {
+        memcpy(folded, data, 16);
+        folded[0] ^= crc & 0xFF;
+        folded[1] ^= crc >> 8;
+        return 16;
+    }
+#endif
+
+    uint16_t m_table[8][256];
+    uint64_t m_foldConstants[4];
+    bool m_hasClMul;
+};
+
+class BluetoothCrc
+{
+public:
+    static const uint32_t bluetoothCrcPoly = 0x11021;
+    static const uint32_t bluetoothCrcRegCnt = 16;
+
+    BluetoothCrc(uint8_t uap)
+        :crc16(BluetoothCrc16::Get())
+    {
+        crc = BluetoothCrc16::Seed(uap);
+    }
+
+    // continues the CRC of everything passed in since construction
+    void CalcCrc(const std::vector<uint8_t>& dataIn, uint16_t& crcVal)
+    {
+        crc = crc16.Update(crc, dataIn.data(), dataIn.size());
+        crcVal = crc;
+    }
+
+    // CRC of one payload for any UAP, no object per UAP needed
+    uint16_t CalcCrc(uint8_t uap, const uint8_t* data, size_t size) const
+    {
+        return crc16.Calc(uap, data, size);
+    }
+
+    // bit serial reference through the LFSR the table engine replaces
+    static uint16_t CalcCrcSerial(uint8_t uap, const std::vector<uint8_t>& dataIn, LfsrEngine engine = LfsrEngine::Serial)
+    {
+        LinearFeedbackShiftRegister lsfr(bluetoothCrcRegCnt, uap, engine);
+        // poly from bluetooth spec for the payload crc
+        lsfr.AddGaloisPoly(bluetoothCrcPoly);
+        // standard generator, only including output of the final register
+        lsfr.AddGeneratorPoly(1 << (bluetoothCrcRegCnt - 1));
+        lsfr.AddInputPoly(bluetoothCrcPoly);
+        lsfr.Shift(static_cast<uint32_t>(dataIn.size() * 8), dataIn);
+        return (uint16_t)lsfr.GetState();
+    }
+
+private:
+
+    const BluetoothCrc16& crc16;
+    uint16_t crc;
+};
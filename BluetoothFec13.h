@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Rate 1/3 repetition code of the packet header. Each of the 18 header bits
+// is sent three times in a row, 54 bits on air, first bit in bit 0, packed in
+// 7 bytes. Decoding is a majority vote of the three copies and a bit is
+// unanimous when all three copies agree, 3 votes, otherwise it won 2 to 1.
+//
+// Decoded headers come out as 3 bytes in the WhitenData layout, ready for
+// dewhitening and the HEC.
+//
+// The vote is bit sliced within the word: the three copies of all 18 bits are
+// lined up with two shifts, so one majority and one agreement expression
+// decode the whole header, then every third bit is packed down in 5 steps.
+class BluetoothFec13
+{
+public:
+    static const uint32_t HEADER_BITS = 18;
+    static const uint32_t CODED_BITS = HEADER_BITS * 3;
+    static const uint32_t CODED_BYTES = (CODED_BITS + 7) / 8;
+    static const uint32_t HEADER_BYTES = (HEADER_BITS + 7) / 8;
+    static const uint32_t HEADER_MASK = (1 << HEADER_BITS) - 1;
+
+    static uint64_t LoadCoded(const uint8_t* coded)
+    {
+        uint64_t bits = 0;
+        for (uint32_t i = 0; i < CODED_BYTES; i++)
+        {
+            bits |= static_cast<uint64_t>(coded[i]) << (8 * i);
+        }
+        return bits & ((1ULL << CODED_BITS) - 1);
+    }
+
+    // 18 decoded header bits, unanimous gets bit n set when all three copies of bit n agree
+    static uint32_t Decode(uint64_t coded, uint32_t& unanimous)
+    {
+        const uint64_t firstCopies = 0x0009249249249249ULL;
+        uint64_t a = coded & firstCopies;
+        uint64_t b = (coded >> 1) & firstCopies;
+        uint64_t c = (coded >> 2) & firstCopies;
+        unanimous = Compress(~(a ^ b) & ~(a ^ c) & firstCopies);
+        return Compress((a & b) | (a & c) | (b & c));
+    }
+
+    static uint32_t Decode(const uint8_t* coded, uint8_t* header, uint32_t& unanimous)
+    {
+        uint32_t bits = Decode(LoadCoded(coded), unanimous);
+        StoreHeader(bits, header);
+        return bits;
+    }
+
+    static uint32_t Votes(uint32_t unanimous, uint32_t bit)
+    {
+        return 2 + ((unanimous >> bit) & 1);
+    }
+
+    // Decodes count headers of CODED_BYTES each into HEADER_BYTES each,
+    // unanimous may be null. Returns the number of headers with a split vote.
+    static size_t Decode(const uint8_t* coded, size_t count, uint8_t* headers, uint32_t* unanimous = nullptr)
+    {
+        size_t splitCount = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t agree = 0;
+            StoreHeader(Decode(LoadCoded(coded + i * CODED_BYTES), agree), headers + i * HEADER_BYTES);
+            if (unanimous != nullptr)
+            {
+                unanimous[i] = agree;
+            }
+            splitCount += agree != HEADER_MASK ? 1 : 0;
+        }
+        return splitCount;
+    }
+
+private:
+    // every third bit of a 54 bit word packed into 18 bits, doubling the
+    // packed group width each step
+    static uint32_t Compress(uint64_t bits)
+    {
+        bits = (bits | bits >> 2) & 0x30C30C30C30C30C3ULL;
+        bits = (bits | bits >> 4) & 0xF00F00F00F00F00FULL;
+        bits = (bits | bits >> 8) & 0x00FF0000FF0000FFULL;
+        bits = (bits | bits >> 16) & 0xFFFF00000000FFFFULL;
+        bits = (bits | bits >> 32) & 0x00000000FFFFFFFFULL;
+        return static_cast<uint32_t>(bits);
+    }
+
+    static void StoreHeader(uint32_t bits, uint8_t* header)
+    {
+        header[0] = bits & 0xFF;
+        header[1] = (bits >> 8) & 0xFF;
+        header[2] = (bits >> 16) & 0x03;
+    }
+};
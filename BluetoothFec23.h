@@ -0,0 +1,195 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "LinearFeedbackShiftRegister.h"
+
+enum class Fec23Status
+{
+    Clean,
+    Corrected,
+    Uncorrectable
+};
+
+// (15,10) shortened Hamming code of the 2/3 rate FEC, generator 0x35.
+// Blocks are 10 data bits followed by 5 parity bits, first bit in bit 0.
+// Parity is linear in the data bits, so encoding is one 1024 entry lookup. The
+// syndrome of a block is the parity of its data bits ^ its parity bits, and
+// each of the 15 single bit errors gives its own non zero syndrome, so a 32
+// entry table maps syndromes to the bit to flip. The other 16 syndromes can
+// only come from 2 or more errors and mark the block uncorrectable.
+class BluetoothFec23
+{
+public:
+    static const uint32_t bluetoothFec23Poly = 0x35;
+    static const uint32_t bluetoothFec23RegCnt = 5;
+    static const uint32_t bluetoothFec23PayloadBitCnt = 10;
+    static const uint32_t BLOCK_BITS = 15;
+    static const uint16_t DATA_MASK = (1 << bluetoothFec23PayloadBitCnt) - 1;
+    static const uint16_t BLOCK_MASK = (1 << BLOCK_BITS) - 1;
+    static const uint8_t NO_ERROR_BIT = 0xFF;
+
+    static const BluetoothFec23& Get()
+    {
+        static const BluetoothFec23 fec;
+        return fec;
+    }
+
+    uint8_t CalcParity(uint16_t data) const
+    {
+        return m_parityTable[data & DATA_MASK];
+    }
+
+    void CalcParity(const std::vector<uint8_t>& dataIn, uint8_t& parity) const
+    {
+        uint16_t data = 0;
+        if (dataIn.size() > 0)
+        {
+            data = dataIn[0];
+        }
+        if (dataIn.size() > 1)
+        {
+            data |= dataIn[1] << 8;
+        }
+        parity = CalcParity(data);
+    }
+
+    uint16_t Encode(uint16_t data) const
+    {
+        data &= DATA_MASK;
+        return data | m_parityTable[data] << bluetoothFec23PayloadBitCnt;
+    }
+
+    Fec23Status Decode(uint16_t block, uint16_t& data) const
+    {
+        uint8_t syndrome = m_parityTable[block & DATA_MASK] ^ ((block >> bluetoothFec23PayloadBitCnt) & 0x1F);
+        uint8_t errorBit = m_syndromeTable[syndrome];
+        if (syndrome != 0 && errorBit == NO_ERROR_BIT)
+        {
+            data = block & DATA_MASK;
+            return Fec23Status::Uncorrectable;
+        }
+        if (syndrome != 0)
+        {
+            block ^= 1 << errorBit;
+        }
+        data = block & DATA_MASK;
+        return syndrome == 0 ? Fec23Status::Clean : Fec23Status::Corrected;
+    }
+
+    // Encodes dataBits packed bits into 15 bit blocks, the last block zero
+    // padded as for DM payloads. dataOut needs EncodedBytes(dataBits) bytes.
+    static size_t EncodedBytes(size_t dataBits)
+    {
+        size_t blocks = (dataBits + bluetoothFec23PayloadBitCnt - 1) / bluetoothFec23PayloadBitCnt;
+        return (blocks * BLOCK_BITS + 7) / 8;
+    }
+
+    size_t Encode(const uint8_t* dataIn, size_t dataBits, uint8_t* dataOut) const
+    {
+        size_t blocks = (dataBits + bluetoothFec23PayloadBitCnt - 1) / bluetoothFec23PayloadBitCnt;
+        size_t inBytes = (dataBits + 7) / 8;
+        size_t outBytes = EncodedBytes(dataBits);
+        for (size_t i = 0; i < outBytes; i++)
+        {
+            dataOut[i] = 0;
+        }
+        for (size_t block = 0; block < blocks; block++)
+        {
+            size_t inBit = block * bluetoothFec23PayloadBitCnt;
+            uint16_t data = static_cast<uint16_t>(ReadBits(dataIn, inBytes, inBit));
+            if (inBit + bluetoothFec23PayloadBitCnt > dataBits)
+            {
+                data &= (1 << (dataBits - inBit)) - 1;
+            }
+            WriteBits(dataOut, block * BLOCK_BITS, Encode(data));
+        }
+        return outBytes;
+    }
+
+    // Decodes blockCount packed 15 bit blocks into blockCount * 10 packed data
+    // bits, dataOut needs (blockCount * 10 + 7) / 8 bytes. Uncorrectable blocks
+    // keep their received data bits. Returns the uncorrectable block count.
+    size_t Decode(const uint8_t* dataIn, size_t blockCount, uint8_t* dataOut, size_t* correctedCount = nullptr) const
+    {
+        size_t inBytes = (blockCount * BLOCK_BITS + 7) / 8;
+        size_t outBytes = (blockCount * bluetoothFec23PayloadBitCnt + 7) / 8;
+        size_t corrected = 0;
+        size_t uncorrectable = 0;
+        for (size_t i = 0; i < outBytes; i++)
+        {
+            dataOut[i] = 0;
+        }
+        for (size_t block = 0; block < blockCount; block++)
+        {
+            uint16_t data = 0;
+            Fec23Status status = Decode(static_cast<uint16_t>(ReadBits(dataIn, inBytes, block * BLOCK_BITS) & BLOCK_MASK), data);
+            corrected += status == Fec23Status::Corrected ? 1 : 0;
+            uncorrectable += status == Fec23Status::Uncorrectable ? 1 : 0;
+            WriteBits(dataOut, block * bluetoothFec23PayloadBitCnt, data);
+        }
+        if (correctedCount != nullptr)
+        {
+            *correctedCount = corrected;
+        }
+        return uncorrectable;
+    }
+
+    // bit serial reference through the LFSR the parity table replaces
+    static uint8_t CalcParitySerial(uint16_t data, LfsrEngine engine = LfsrEngine::Serial)
+    {
+        LinearFeedbackShiftRegister lsfr(bluetoothFec23RegCnt, 0, engine);
+        lsfr.AddGaloisPoly(bluetoothFec23Poly);
+        // standard generator, only including output of the final register
+        lsfr.AddGeneratorPoly(1 << (bluetoothFec23RegCnt - 1));
+        lsfr.AddInputPoly(bluetoothFec23Poly);
+        std::vector<uint8_t> dataIn = { static_cast<uint8_t>(data & 0xFF), static_cast<uint8_t>((data >> 8) & 0x3) };
+        lsfr.Shift(bluetoothFec23PayloadBitCnt, dataIn);
+        return (uint8_t)lsfr.GetState();
+    }
+
+private:
+    BluetoothFec23()
+    {
+        for (uint32_t data = 0; data <= DATA_MASK; data++)
+        {
+            m_parityTable[data] = CalcParitySerial(static_cast<uint16_t>(data), LfsrEngine::WordParallel);
+        }
+        for (uint32_t syndrome = 0; syndrome < 32; syndrome++)
+        {
+            m_syndromeTable[syndrome] = NO_ERROR_BIT;
+        }
+        for (uint32_t bit = 0; bit < BLOCK_BITS; bit++)
+        {
+            uint16_t block = static_cast<uint16_t>(1 << bit);
+            m_syndromeTable[m_parityTable[block & DATA_MASK] ^ (block >> bluetoothFec23PayloadBitCnt)] = static_cast<uint8_t>(bit);
+        }
+    }
+
+    // up to 16 bits from bitOffset, bytes past size read as zero
+    static uint32_t ReadBits(const uint8_t* data, size_t size, size_t bitOffset)
+    {
+        size_t byteIndex = bitOffset >> 3;
+        uint32_t bits = 0;
+        for (size_t i = 0; i < 3 && byteIndex + i < size; i++)
+        {
+            bits |= data[byteIndex + i] << (8 * i);
+        }
+        return bits >> (bitOffset & 7);
+    }
+
+    // ors bits into data at bitOffset, the destination bits must be clear
+    static void WriteBits(uint8_t* data, size_t bitOffset, uint32_t bits)
+    {
+        size_t byteIndex = bitOffset >> 3;
+        bits <<= bitOffset & 7;
+        while (bits != 0)
+        {
+            data[byteIndex++] |= bits & 0xFF;
+            bits >>= 8;
+        }
+    }
+
+    uint8_t m_parityTable[DATA_MASK + 1];
+    uint8_t m_syndromeTable[32];
+};
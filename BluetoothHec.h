@@ -0,0 +1,116 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "LinearFeedbackShiftRegister.h"
+
+// Process wide HEC lookup. The HEC register is linear in both the UAP it is
+// seeded with and the 10 header bits shifted through it, so
+// HEC(uap, header) = HEC(uap, 0) ^ HEC(0, header), one 256 entry table for the
+// UAP and one 1024 entry table for the header bits, 1.25 KB in all.
+// Values use the LinearFeedbackShiftRegister::GetState order of the bit serial HEC.
+class BluetoothHecTable
+{
+public:
+    static const uint32_t bluetoothHecPoly = 0x1A7;
+    static const uint32_t bluetoothHecRegCnt = 8;
+    static const uint32_t bluetoothHecPayloadBitCnt = 10;
+    static const uint16_t HEADER_MASK = (1 << bluetoothHecPayloadBitCnt) - 1;
+
+    static const BluetoothHecTable& Get()
+    {
+        static const BluetoothHecTable table;
+        return table;
+    }
+
+    uint8_t UapPart(uint8_t uap) const { return m_uapTable[uap]; }
+    uint8_t HeaderPart(uint16_t header) const { return m_headerTable[header & HEADER_MASK]; }
+
+    uint8_t Calc(uint8_t uap, uint16_t header) const
+    {
+        return m_uapTable[uap] ^ m_headerTable[header & HEADER_MASK];
+    }
+
+    // bit serial reference through the LFSR the tables replace
+    static uint8_t CalcSerial(uint8_t uap, uint16_t header, LfsrEngine engine = LfsrEngine::Serial)
+    {
+        LinearFeedbackShiftRegister lsfr(bluetoothHecRegCnt, uap, engine);
+        // poly from bluetooth spec for the header error check
+        lsfr.AddGaloisPoly(bluetoothHecPoly);
+        // standard generator, only including output of the final register
+        lsfr.AddGeneratorPoly(1 << (bluetoothHecRegCnt - 1));
+        lsfr.AddInputPoly(bluetoothHecPoly);
+        std::vector<uint8_t> dataIn = { static_cast<uint8_t>(header & 0xFF), static_cast<uint8_t>((header >> 8) & 0x3) };
+        lsfr.Shift(bluetoothHecPayloadBitCnt, dataIn);
+        return (uint8_t)lsfr.GetState();
+    }
+
+private:
+    BluetoothHecTable()
+    {
+        for (uint32_t uap = 0; uap < 256; uap++)
+        {
+            m_uapTable[uap] = CalcSerial(static_cast<uint8_t>(uap), 0, LfsrEngine::WordParallel);
+        }
+        for (uint32_t header = 0; header <= HEADER_MASK; header++)
+        {
+            m_headerTable[header] = CalcSerial(0, static_cast<uint16_t>(header), LfsrEngine::WordParallel);
+        }
+    }
+
+    uint8_t m_uapTable[256];
+    uint8_t m_headerTable[HEADER_MASK + 1];
+};
+
+class BluetoothHec
+{
+public:
+    BluetoothHec(uint8_t uap)
+        :table(BluetoothHecTable::Get())
+    {
+        m_uap = uap;
+    }
+
+    void CalcHec(uint8_t uap, const std::vector<uint8_t>& dataIn, uint8_t& hecVal)
+    {
+        uint16_t header = 0;
+        if (dataIn.size() > 0)
+        {
+            header = dataIn[0];
+        }
+        if (dataIn.size() > 1)
+        {
+            header |= dataIn[1] << 8;
+        }
+        hecVal = table.Calc(uap, header);
+    }
+
+    uint8_t CalcHec(uint16_t header) const
+    {
+        return table.Calc(m_uap, header);
+    }
+
+    // HECs for count packed 10 bit headers, all against the UAP of this object
+    void CalcHec(const uint16_t* headers, size_t count, uint8_t* hecOut) const
+    {
+        const uint8_t uapPart = table.UapPart(m_uap);
+        for (size_t i = 0; i < count; i++)
+        {
+            hecOut[i] = uapPart ^ table.HeaderPart(headers[i]);
+        }
+    }
+
+    // HECs for count packed 10 bit headers, each against its own UAP
+    void CalcHec(const uint8_t* uaps, const uint16_t* headers, size_t count, uint8_t* hecOut) const
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            hecOut[i] = table.UapPart(uaps[i]) ^ table.HeaderPart(headers[i]);
+        }
+    }
+
+private:
+
+    const BluetoothHecTable& table;
+    uint8_t m_uap;
+};
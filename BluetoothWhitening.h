@@ -1,4 +1,233 @@
 #pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "LinearFeedbackShiftRegister.h"
 
+// Whitening keystream shared by every BluetoothWhitening, built once on first use.
+// The 7 register whitening LFSR has period 127 and each of the 64 seeds is just a
+// phase of the same sequence, so only the bit offset of each seed is kept.
+// The table holds the sequence as bytes, byte j being keystream bits 8j - 8j+7
+// mod 127. As 8 * 16 = 1 mod 127, the 8 bits starting at any offset q are byte
+// 16q mod 127 and the bits after them follow byte by byte, so whitening from any
+// offset is a plain byte XOR against the table.
+class WhiteningKeystream
+{
+public:
+    static const uint32_t PERIOD_BITS = 127;
+    // long enough that any offset leaves a full 1021 byte payload before wrapping
+    static const uint32_t TABLE_SIZE = PERIOD_BITS * 10;
 
+    static const WhiteningKeystream& Get()
+    {
+        static const WhiteningKeystream keystream;
+        return keystream;
+    }
 
+    // keystream bit offset of the first whitening bit for clock bits 1 - 6
+    uint32_t GetSeedOffset(uint32_t clock) const
+    {
+        return m_seedOffsets[(clock >> 1) & 0x3F];
+    }
+
+    // the 8 keystream bits starting at bitOffset, first bit in bit 0
+    uint8_t GetByte(uint32_t bitOffset) const
+    {
+        return m_table[TableIndex(bitOffset)];
+    }
+
+    // dataOut[i] = dataIn[i] ^ keystream byte at bitOffset + 8i, dataIn may equal dataOut
+    void Xor(const uint8_t* dataIn, uint8_t* dataOut, size_t size, uint32_t bitOffset) const
+    {
+        uint32_t tableIndex = TableIndex(bitOffset);
+        while (size > 0)
+        {
+            size_t chunk = TABLE_SIZE - tableIndex;
+            chunk = chunk < size ? chunk : size;
+            const uint8_t* code = &m_table[tableIndex];
+            size_t i = 0;
+            // unaligned 8 byte words, the compiler widens these to vector XORs
+            for (; i + 8 <= chunk; i += 8)
+            {
+                uint64_t data;
+                uint64_t codeWord;
+                memcpy(&data, dataIn + i, sizeof(data));
+                memcpy(&codeWord, code + i, sizeof(codeWord));
+                data ^= codeWord;
+                memcpy(dataOut + i, &data, sizeof(data));
+            }
+            for (; i < chunk; i++)
+            {
+                dataOut[i] = dataIn[i] ^ code[i];
+            }
+            dataIn += chunk;
+            dataOut += chunk;
+            size -= chunk;
+            tableIndex = static_cast<uint32_t>((tableIndex + chunk) % PERIOD_BITS);
+        }
+    }
+
+    // XORs bitLength keystream bits, starting at keystream bit bitOffsetKeystream,
+    // onto bits bitOffset onward of a packed buffer, first bit in bit 0 of each
+    // byte. Bits outside the range are copied from dataIn, dataOut may be dataIn.
+    void XorBits(const uint8_t* dataIn, uint8_t* dataOut, size_t bitOffset, size_t bitLength, uint32_t bitOffsetKeystream) const
+    {
+        size_t byteIndex = bitOffset / 8;
+        uint32_t bitShift = bitOffset & 0x7;
+
+        if (bitShift != 0 && bitLength > 0)
+        {
+            uint32_t bitCount = 8 - bitShift;
+            bitCount = bitCount < bitLength ? bitCount : static_cast<uint32_t>(bitLength);
+            uint8_t mask = static_cast<uint8_t>(((1u << bitCount) - 1) << bitShift);
+            dataOut[byteIndex] = dataIn[byteIndex] ^ (static_cast<uint8_t>(GetByte(bitOffsetKeystream) << bitShift) & mask);
+            byteIndex++;
+            bitLength -= bitCount;
+            bitOffsetKeystream += bitCount;
+        }
+
+        size_t byteCount = bitLength / 8;
+        Xor(dataIn + byteIndex, dataOut + byteIndex, byteCount, bitOffsetKeystream);
+        byteIndex += byteCount;
+        bitOffsetKeystream += static_cast<uint32_t>((byteCount * 8) % PERIOD_BITS);
+
+        uint32_t lastBits = bitLength & 0x7;
+        if (lastBits != 0)
+        {
+            uint8_t mask = static_cast<uint8_t>((1u << lastBits) - 1);
+            dataOut[byteIndex] = dataIn[byteIndex] ^ (GetByte(bitOffsetKeystream) & mask);
+        }
+    }
+
+private:
+    WhiteningKeystream()
+    {
+        // poly from bluetooth spec for whitening, output of the final register
+        LinearFeedbackShiftRegister lsfr(7, 0x40);
+        lsfr.AddGaloisPoly(0x91);
+        lsfr.AddGeneratorPoly(0x40);
+
+        uint8_t stateOffsets[128] = { 0 };
+        for (uint32_t offset = 0; offset < PERIOD_BITS; offset++)
+        {
+            stateOffsets[lsfr.GetState() & 0x7F] = static_cast<uint8_t>(offset);
+            lsfr.JumpAhead(1);
+        }
+        for (uint32_t clk6 = 0; clk6 < 64; clk6++)
+        {
+            lsfr.Reset(0x40 | clk6);
+            m_seedOffsets[clk6] = stateOffsets[lsfr.GetState() & 0x7F];
+        }
+
+        lsfr.Reset(0x40);
+        lsfr.Shift(PERIOD_BITS * 8);
+        std::vector<uint8_t> period = lsfr.GetDataOut(0);
+        for (uint32_t i = 0; i < TABLE_SIZE; i++)
+        {
+            m_table[i] = period[i % PERIOD_BITS];
+        }
+    }
+
+    static uint32_t TableIndex(uint32_t bitOffset)
+    {
+        return ((bitOffset % PERIOD_BITS) * 16) % PERIOD_BITS;
+    }
+
+    uint8_t m_table[TABLE_SIZE];
+    uint32_t m_seedOffsets[64];
+};
+
+class BluetoothWhitening
+{
+public:
+    static const uint32_t HEADER_SIZE_BITS = 18;
+
+    BluetoothWhitening(uint32_t clock)
+        :keystream(WhiteningKeystream::Get())
+    {
+        seedOffset = keystream.GetSeedOffset(clock);
+    }
+
+    void WhitenData(const std::vector<uint8_t>& dataIn, std::vector<uint8_t>& dataOut)
+    {
+        dataOut.resize(dataIn.size());
+        WhitenData(dataIn.data(), dataIn.size(), dataOut.data(), dataOut.size());
+    }
+
+    // Whitens a header in the first 3 bytes followed by a byte aligned payload,
+    // starting bitOffset bits into the keystream. Writes min(inSize, outSize)
+    // bytes and returns that count. dataOut may be dataIn, nothing is allocated.
+    size_t WhitenData(const uint8_t* dataIn, size_t inSize, uint8_t* dataOut, size_t outSize, uint32_t bitOffset = 0)
+    {
+        const uint8_t BIT_MASK_TABLE[7] =
+        {
+            0x01,
+            0x03,
+            0x07,
+            0x0F,
+            0x1F,
+            0x3F,
+            0x7F,
+        };
+        const size_t size = inSize < outSize ? inSize : outSize;
+        const uint32_t headerOffset = seedOffset + bitOffset;
+        size_t dataIndex = 0;
+
+        for (; dataIndex < HEADER_SIZE_BITS/8 && dataIndex < size; dataIndex++)
+        {
+            dataOut[dataIndex] = dataIn[dataIndex] ^ keystream.GetByte(headerOffset + static_cast<uint32_t>(dataIndex * 8));
+        }
+        uint8_t lastByteBits = HEADER_SIZE_BITS & 0x7;
+        if (lastByteBits != 0 && dataIndex < size)
+        {
+            dataOut[dataIndex] = (dataIn[dataIndex] ^ keystream.GetByte(headerOffset + static_cast<uint32_t>(dataIndex * 8))) & BIT_MASK_TABLE[lastByteBits - 1];
+            dataIndex++;
+        }
+
+        if (dataIndex < size)
+        {
+            keystream.Xor(dataIn + dataIndex, dataOut + dataIndex, size - dataIndex, headerOffset + HEADER_SIZE_BITS);
+        }
+        return size;
+    }
+
+    // in place version of the above
+    void WhitenData(uint8_t* data, size_t size, uint32_t bitOffset = 0)
+    {
+        WhitenData(data, size, data, size, bitOffset);
+    }
+
+    // Whitens a payload that starts right after the header
+    void WhitenPayload(const std::vector<uint8_t>& dataIn, std::vector<uint8_t>& dataOut)
+    {
+        dataOut.resize(dataIn.size());
+        WhitenPayload(dataIn.data(), dataOut.data(), dataIn.size());
+    }
+
+    // Whitens size payload bytes, bitOffset being the payload bits already
+    // whitened so a payload can be split across buffers. dataOut may be dataIn.
+    void WhitenPayload(const uint8_t* dataIn, uint8_t* dataOut, size_t size, uint32_t bitOffset = 0)
+    {
+        keystream.Xor(dataIn, dataOut, size, seedOffset + HEADER_SIZE_BITS + bitOffset);
+    }
+
+    // Whitens bitLength bits of a packed bit stream, for example demodulator
+    // output, where the header starts at bit bitOffset and the payload follows
+    // it directly. Header and payload are whitened in one pass with no repacking.
+    void WhitenBits(const uint8_t* dataIn, uint8_t* dataOut, size_t bitOffset, size_t bitLength)
+    {
+        keystream.XorBits(dataIn, dataOut, bitOffset, bitLength, seedOffset);
+    }
+
+    // in place version of the above
+    void WhitenBits(uint8_t* data, size_t bitOffset, size_t bitLength)
+    {
+        keystream.XorBits(data, data, bitOffset, bitLength, seedOffset);
+    }
+
+private:
+
+    const WhiteningKeystream& keystream;
+    uint32_t seedOffset;
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "SelectionKernel.h"
+
+// AFH channel map of the adapted channel. The map is the 10 byte form LMP and
+// HCI carry, bit n of the little endian 79 bit value set for used channel n.
+// A kernel output on a used channel is kept, any other is remapped to entry
+// (PERM5 + E + F' + Y2) % N of the mapping table, the even used channels in
+// ascending order followed by the odd ones, the order the basic remap visits
+// them in. Set builds the used flags and a remap table indexed by that sum
+// with the mod N folded in once per map, so a slot never scans the map, and a
+// map that did not change costs one compare.
+class ChannelMap
+{
+public:
+    static const uint32_t MAP_SIZE = 10;
+    // Nmin, the fewest used channels a map may have
+    static const uint32_t MIN_USED = 20;
+    // PERM5 + E + F', F' being below N
+    static const uint32_t MAX_REMAP_SUM = 31 + 127 + SelectionKernelTables::CHANNEL_COUNT - 1;
+
+    // all 79 channels used, the basic channel
+    ChannelMap()
+    {
+        uint8_t map[MAP_SIZE];
+        memset(map, 0xFF, sizeof(map));
+        map[MAP_SIZE - 1] = 0x7F;
+        Build(map);
+    }
+
+    // Returns false, keeping the current map, when map has fewer than
+    // MIN_USED channels. Bit 79 is reserved and ignored.
+    bool Set(const uint8_t* map)
+    {
+        uint8_t masked[MAP_SIZE];
+        memcpy(masked, map, MAP_SIZE);
+        masked[MAP_SIZE - 1] &= 0x7F;
+        if (memcmp(masked, m_map, MAP_SIZE) == 0)
+        {
+            return true;
+        }
+        return Build(masked);
+    }
+
+    const uint8_t* GetMap() const { return m_map; }
+
+    // N
+    uint32_t UsedCount() const { return m_usedCount; }
+
+    bool IsUsed(uint32_t channel) const
+    {
+        return m_used[channel] != 0;
+    }
+
+    // entry index % N of the mapping table
+    uint8_t UsedChannel(uint32_t index) const
+    {
+        return m_remap[index % m_usedCount];
+    }
+
+    // remapped channel of PERM5 + E + F' + Y2
+    uint8_t Remap(uint32_t sum) const
+    {
+        return m_remap[sum];
+    }
+
+private:
+    // one branch free pass for the mapping table, then the remap table as
+    // copies of it
+    bool Build(const uint8_t* map)
+    {
+        uint8_t usedChannels[SelectionKernelTables::CHANNEL_COUNT];
+        uint32_t usedCount = 0;
+        // channel 2 x i % 79, all even channels and then all odd ones
+        for (uint32_t i = 0, channel = 0; i < SelectionKernelTables::CHANNEL_COUNT; i++)
+        {
+            usedChannels[usedCount] = static_cast<uint8_t>(channel);
+            usedCount += (map[channel >> 3] >> (channel & 7)) & 1;
+            channel = channel + 2 < SelectionKernelTables::CHANNEL_COUNT ? channel + 2 : channel + 2 - SelectionKernelTables::CHANNEL_COUNT;
+        }
+        if (usedCount < MIN_USED)
+        {
+            return false;
+        }
+
+        memcpy(m_map, map, MAP_SIZE);
+        m_usedCount = usedCount;
+        memset(m_used, 0, sizeof(m_used));
+        for (uint32_t i = 0; i < usedCount; i++)
+        {
+            m_used[usedChannels[i]] = 1;
+        }
+        for (uint32_t sum = 0; sum <= MAX_REMAP_SUM; sum += usedCount)
+        {
+            uint32_t size = MAX_REMAP_SUM + 1 - sum < usedCount ? MAX_REMAP_SUM + 1 - sum : usedCount;
+            memcpy(&m_remap[sum], usedChannels, size);
+        }
+        return true;
+    }
+
+    uint8_t m_map[MAP_SIZE];
+    uint32_t m_usedCount;
+    uint8_t m_used[SelectionKernelTables::CHANNEL_COUNT];
+    uint8_t m_remap[MAX_REMAP_SUM + 1];
+};
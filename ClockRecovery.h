@@ -0,0 +1,128 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "BluetoothWhitening.h"
+#include "BluetoothHec.h"
+
+// Recovers clock bits 1 - 6 of a captured packet by trying all 64 whitening
+// seeds against the HEC of its header. The 18 header keystream bits of every
+// seed are taken once from the shared whitening keystream, so testing a header
+// is 64 xors and table lookups.
+//
+// With a known UAP a seed survives when its dewhitened header has a valid HEC.
+// With an unknown UAP every seed gives exactly one consistent UAP, as the HEC
+// UAP contribution is invertible, so headers at known clock distances are
+// needed to narrow the (clock, UAP) pairs down. Clocks 64 ticks apart always
+// stay paired: their seeds differ in one bit whatever the clock distance, so
+// the keystream difference is the same for every header and only the payload
+// CRC can tell them apart.
+//
+// Headers are 3 whitened bytes in the WhitenData layout. Clocks are Bluetooth
+// clock values with bit 0 clear, as used by the seed.
+class ClockRecovery
+{
+public:
+    static const uint32_t SEED_COUNT = 64;
+    static const uint32_t HEADER_BITS_MASK = (1 << BluetoothWhitening::HEADER_SIZE_BITS) - 1;
+
+    ClockRecovery()
+        :hecTable(BluetoothHecTable::Get())
+    {
+        const WhiteningKeystream& keystream = WhiteningKeystream::Get();
+        for (uint32_t clk6 = 0; clk6 < SEED_COUNT; clk6++)
+        {
+            uint32_t offset = keystream.GetSeedOffset(clk6 << 1);
+            seedKeystream[clk6] = (keystream.GetByte(offset) | keystream.GetByte(offset + 8) << 8 | keystream.GetByte(offset + 16) << 16) & HEADER_BITS_MASK;
+        }
+        for (uint32_t uap = 0; uap < 256; uap++)
+        {
+            uapInverse[hecTable.UapPart(static_cast<uint8_t>(uap))] = static_cast<uint8_t>(uap);
+        }
+        Reset();
+    }
+
+    static uint32_t PackHeader(const uint8_t* header)
+    {
+        return (header[0] | header[1] << 8 | header[2] << 16) & HEADER_BITS_MASK;
+    }
+
+    // bit n set when clock 2n dewhitens the header to a valid HEC for uap
+    uint64_t ValidClocks(uint8_t uap, const uint8_t* header) const
+    {
+        const uint32_t headerBits = PackHeader(header);
+        const uint8_t uapPart = hecTable.UapPart(uap);
+        uint64_t valid = 0;
+        for (uint32_t clk6 = 0; clk6 < SEED_COUNT; clk6++)
+        {
+            uint32_t bits = headerBits ^ seedKeystream[clk6];
+            uint8_t hec = static_cast<uint8_t>(bits >> 10) ^ hecTable.HeaderPart(bits & BluetoothHecTable::HEADER_MASK);
+            valid |= static_cast<uint64_t>(hec == uapPart) << clk6;
+        }
+        return valid;
+    }
+
+    // uaps[n] is the only UAP giving the header a valid HEC at clock 2n
+    void CandidateUaps(const uint8_t* header, uint8_t* uaps) const
+    {
+        const uint32_t headerBits = PackHeader(header);
+        for (uint32_t clk6 = 0; clk6 < SEED_COUNT; clk6++)
+        {
+            uint32_t bits = headerBits ^ seedKeystream[clk6];
+            uint8_t hec = static_cast<uint8_t>(bits >> 10) ^ hecTable.HeaderPart(bits & BluetoothHecTable::HEADER_MASK);
+            uaps[clk6] = uapInverse[hec];
+        }
+    }
+
+    void Reset()
+    {
+        validMask = ~0ULL;
+        headerCount = 0;
+    }
+
+    // Narrows the candidates for the clock of the first header, clockDelta
+    // being the clock ticks since that header.
+    void AddHeader(uint8_t uap, const uint8_t* header, uint32_t clockDelta)
+    {
+        uint64_t valid = ValidClocks(uap, header);
+        validMask &= RotateToBase(valid, clockDelta);
+        headerCount++;
+    }
+
+    void AddHeader(const uint8_t* header, uint32_t clockDelta)
+    {
+        uint8_t uaps[SEED_COUNT];
+        CandidateUaps(header, uaps);
+        const uint32_t shift = (clockDelta >> 1) & (SEED_COUNT - 1);
+        for (uint32_t clk6 = 0; clk6 < SEED_COUNT; clk6++)
+        {
+            uint8_t uap = uaps[(clk6 + shift) & (SEED_COUNT - 1)];
+            if (headerCount == 0)
+            {
+                pairUaps[clk6] = uap;
+            }
+            validMask &= ~(static_cast<uint64_t>(pairUaps[clk6] != uap) << clk6);
+        }
+        headerCount++;
+    }
+
+    // bit n set when clock 2n is still consistent with every header added
+    uint64_t GetValidClocks() const { return validMask; }
+    // UAP paired with clock 2n, only meaningful for the unknown UAP AddHeader
+    uint8_t GetPairUap(uint32_t clock) const { return pairUaps[(clock >> 1) & (SEED_COUNT - 1)]; }
+    uint32_t GetHeaderCount() const { return headerCount; }
+
+private:
+    // moves bit n of a mask for clock base + delta to bit n for clock base
+    static uint64_t RotateToBase(uint64_t mask, uint32_t clockDelta)
+    {
+        const uint32_t shift = (clockDelta >> 1) & (SEED_COUNT - 1);
+        return shift == 0 ? mask : (mask >> shift) | (mask << (SEED_COUNT - shift));
+    }
+
+    const BluetoothHecTable& hecTable;
+    uint32_t seedKeystream[SEED_COUNT];
+    uint8_t uapInverse[256];
+    uint8_t pairUaps[SEED_COUNT];
+    uint64_t validMask;
+    uint32_t headerCount;
+};
@@ -0,0 +1,185 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Parses the space separated hex text the tools exchange, the same way
+// fscanf("%02X") did: whitespace separates bytes, a run of hex digits is read
+// two digits to a byte, a lone digit before whitespace is a byte of its own,
+// and parsing stops at the first character that is neither, keeping a lone
+// digit right before it.
+//
+// Text can be fed in blocks of any size, a byte split across two blocks is
+// carried over. The common "HH " pattern is decoded three characters at a
+// time through one lookup table. Long text is parsed BLOCK_SIZE characters at
+// a time and the output is grown once per block for the most bytes the block
+// can hold, so text that stops early, such as a binary file, never reserves
+// output for the rest of it.
+class HexParser
+{
+public:
+    static const size_t BLOCK_SIZE = 1 << 16;
+
+    HexParser(std::vector<uint8_t>& dataOut)
+        :out(dataOut),
+        pendingDigits(0),
+        pendingValue(0),
+        stopped(false)
+    {
+    }
+
+    // false once a character that is neither hex nor whitespace was seen,
+    // the rest of the text is then ignored
+    bool Feed(const char* text, size_t size)
+    {
+        for (size_t start = 0; start < size; start += BLOCK_SIZE)
+        {
+            if (FeedBlock(text + start, size - start < BLOCK_SIZE ? size - start : BLOCK_SIZE) == false)
+            {
+                return false;
+            }
+        }
+        return stopped == false;
+    }
+
+    // flushes a lone digit at the end of the text
+    void Finish()
+    {
+        if (pendingDigits != 0 && stopped == false)
+        {
+            out.push_back(pendingValue);
+        }
+        pendingDigits = 0;
+    }
+
+    // whole text in one go, returns the number of bytes appended to dataOut
+    static size_t Parse(const char* text, size_t size, std::vector<uint8_t>& dataOut)
+    {
+        size_t startSize = dataOut.size();
+        HexParser parser(dataOut);
+        parser.Feed(text, size);
+        parser.Finish();
+        return dataOut.size() - startSize;
+    }
+
+private:
+    static const uint8_t NOT_HEX = 0x10;
+    static const uint8_t SPACE = 0x10;
+    static const uint8_t INVALID = 0x11;
+
+    // hex digit value, SPACE or INVALID for every character
+    struct CharTable
+    {
+        static const CharTable& Get()
+        {
+            static const CharTable table;
+            return table;
+        }
+
+        CharTable()
+        {
+            for (uint32_t c = 0; c < 256; c++)
+            {
+                value[c] = INVALID;
+            }
+            for (uint32_t c = '0'; c <= '9'; c++)
+            {
+                value[c] = static_cast<uint8_t>(c - '0');
+            }
+            for (uint32_t c = 0; c < 6; c++)
+            {
+                value['A' + c] = static_cast<uint8_t>(10 + c);
+                value['a' + c] = static_cast<uint8_t>(10 + c);
+            }
+            const char spaces[] = { ' ', '\t', '\n', '\v', '\f', '\r' };
+            for (size_t c = 0; c < sizeof(spaces); c++)
+            {
+                value[static_cast<uint8_t>(spaces[c])] = SPACE;
+            }
+        }
+
+        uint8_t value[256];
+    };
+
+    // at most BLOCK_SIZE characters
+    bool FeedBlock(const char* text, size_t size)
+    {
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(text);
+        const CharTable& table = CharTable::Get();
+        if (stopped)
+        {
+            return false;
+        }
+
+        size_t outIndex = out.size();
+        out.resize(outIndex + size / 2 + 1);
+        uint8_t* outData = out.data();
+        size_t i = 0;
+        while (i < size)
+        {
+            if (pendingDigits == 0)
+            {
+                // fast path, two digits and a separator
+                while (i + 3 <= size)
+                {
+                    uint8_t high = table.value[in[i]];
+                    uint8_t low = table.value[in[i + 1]];
+                    if (((high | low) & NOT_HEX) != 0 || table.value[in[i + 2]] != SPACE)
+                    {
+                        break;
+                    }
+                    outData[outIndex++] = static_cast<uint8_t>(high << 4 | low);
+                    i += 3;
+                }
+                if (i >= size)
+                {
+                    break;
+                }
+            }
+
+            uint8_t value = table.value[in[i]];
+            if (value == SPACE)
+            {
+                if (pendingDigits != 0)
+                {
+                    outData[outIndex++] = pendingValue;
+                    pendingDigits = 0;
+                }
+            }
+            else if (value == INVALID)
+            {
+                Stop(outIndex);
+                return false;
+            }
+            else if (pendingDigits == 0)
+            {
+                pendingValue = value;
+                pendingDigits = 1;
+            }
+            else
+            {
+                outData[outIndex++] = static_cast<uint8_t>(pendingValue << 4 | value);
+                pendingDigits = 0;
+            }
+            i++;
+        }
+        out.resize(outIndex);
+        return true;
+    }
+
+    void Stop(size_t outIndex)
+    {
+        if (pendingDigits != 0)
+        {
+            out[outIndex++] = pendingValue;
+        }
+        out.resize(outIndex);
+        stopped = true;
+        pendingDigits = 0;
+    }
+
+    std::vector<uint8_t>& out;
+    uint32_t pendingDigits;
+    uint8_t pendingValue;
+    bool stopped;
+};
@@ -0,0 +1,179 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "SelectionKernel.h"
+#include "ChannelMap.h"
+
+// Hop selection state of one device address, built once and then looked up
+// per slot. The kernel inputs A - E only depend on the 28 address bits, and
+// outside the connection state F and Y2 are 0 or follow Y1, so every channel
+// the scan, page, inquiry and response substates can reach is one of 64:
+// PERM5 and the remap for each X with Y1 = 0 and with Y1 = 1.
+//
+// The connection state adds the clock to A, C, D and F, see BasicChannels and
+// AdaptedChannels.
+//
+// address holds A27_0, UAP3_0 above the LAP. Inquiry and inquiry scan use
+// the GIAC with DCI 0 as their address.
+class HopSequence
+{
+public:
+    static const uint32_t GIAC_ADDRESS = 0x9E8B33;
+    static const uint32_t CLOCK_MASK = 0xFFFFFFF;
+
+    explicit HopSequence(uint32_t address)
+    {
+        m_address = address & 0xFFFFFFF;
+        m_A = (address >> 23) & 0x1F;
+        m_B = (address >> 19) & 0xF;
+        m_C = 0;
+        for (uint32_t bit = 0; bit < 5; bit++)
+        {
+            m_C |= ((address >> (2 * bit)) & 1) << bit;
+        }
+        m_D = (address >> 10) & 0x1FF;
+        m_E = 0;
+        for (uint32_t bit = 0; bit < 7; bit++)
+        {
+            m_E |= ((address >> (2 * bit + 1)) & 1) << bit;
+        }
+
+        const SelectionKernelTables& tables = SelectionKernelTables::Get();
+        for (uint32_t Y1 = 0; Y1 < 2; Y1++)
+        {
+            uint8_t perm[32];
+            tables.BuildPermutation(m_C, m_D, static_cast<uint8_t>(Y1), perm);
+            for (uint32_t X = 0; X < 32; X++)
+            {
+                uint32_t z = ((X + m_A) & 0x1F) ^ m_B;
+                m_channels[Y1][X] = tables.Channel(perm[z] + m_E + 32 * Y1);
+            }
+        }
+    }
+
+    uint32_t GetAddress() const { return m_address; }
+    uint8_t A() const { return m_A; }
+    uint8_t B() const { return m_B; }
+    uint8_t C() const { return m_C; }
+    uint16_t D() const { return m_D; }
+    uint8_t E() const { return m_E; }
+
+    // page scan and inquiry scan, X = CLKN16_12 or Xir4_0, Y1 = 0
+    uint8_t ScanChannel(uint32_t X) const
+    {
+        return m_channels[0][X & 0x1F];
+    }
+
+    // page, inquiry and the three responses, X = Xp, Xi, Xprc, Xprp or Xir,
+    // Y1 = CLKE1, CLKN1 or 1 and Y2 = 32 x Y1
+    uint8_t TrainChannel(uint32_t X, uint32_t Y1) const
+    {
+        return m_channels[Y1 & 1][X & 0x1F];
+    }
+
+    // the 32 channels of one Y1, in X order
+    const uint8_t* Channels(uint32_t Y1) const
+    {
+        return m_channels[Y1 & 1];
+    }
+
+    // Basic channel of the connection state for count slots, the first one at
+    // clk and each following one 2 ticks later, clk wrapping at 28 bits. CLK0
+    // is dropped as slots start on even ticks. Per slot X = CLK6_2, Y1 = CLK1
+    // and Y2 = 32 x CLK1, while A, C, D and F only change with CLK27_7, so
+    // every 64 slot block costs two PERM5 tables and then a lookup per slot.
+    void BasicChannels(uint32_t clk, uint8_t* channels, size_t count) const
+    {
+        const SelectionKernelTables& tables = SelectionKernelTables::Get();
+        clk &= CLOCK_MASK & ~1u;
+        while (count != 0)
+        {
+            uint32_t block = clk >> 7;
+            uint8_t A = (m_A ^ (block >> 14)) & 0x1F;
+            uint8_t C = (m_C ^ (block >> 9)) & 0x1F;
+            uint16_t D = (m_D ^ block) & 0x1FF;
+            uint32_t F = (16 * block) % SelectionKernelTables::CHANNEL_COUNT;
+
+            uint8_t perm[2][32];
+            tables.BuildPermutation(C, D, 0, perm[0]);
+            tables.BuildPermutation(C, D, 1, perm[1]);
+
+            uint32_t slot = (clk & 0x7F) >> 1;
+            size_t blockCount = 64 - slot < count ? 64 - slot : count;
+            for (size_t i = 0; i < blockCount; i++, slot++)
+            {
+                uint32_t X = slot >> 1;
+                uint32_t Y1 = slot & 1;
+                uint32_t z = ((X + A) & 0x1F) ^ m_B;
+                channels[i] = tables.Channel(perm[Y1][z] + m_E + F + 32 * Y1);
+            }
+            channels += blockCount;
+            count -= blockCount;
+            clk = (clk + 2 * static_cast<uint32_t>(blockCount)) & CLOCK_MASK;
+        }
+    }
+
+    // Adapted channel of the connection state under map, laid out as
+    // BasicChannels. The peripheral answers on the channel the central used,
+    // so Y1 and Y2 are 0 and the two slots of each X share a channel. The
+    // kernel output is kept when map uses it, otherwise PERM5 + E + F' picks
+    // the used channel, F' = 16 x CLK27_7 % N.
+    void AdaptedChannels(uint32_t clk, const ChannelMap& map, uint8_t* channels, size_t count) const
+    {
+        const SelectionKernelTables& tables = SelectionKernelTables::Get();
+        clk &= CLOCK_MASK & ~1u;
+        while (count != 0)
+        {
+            uint32_t block = clk >> 7;
+            uint8_t A = (m_A ^ (block >> 14)) & 0x1F;
+            uint8_t C = (m_C ^ (block >> 9)) & 0x1F;
+            uint16_t D = (m_D ^ block) & 0x1FF;
+            uint32_t F = m_E + (16 * block) % SelectionKernelTables::CHANNEL_COUNT;
+            uint32_t Fprime = m_E + (16 * block) % map.UsedCount();
+
+            uint8_t perm[32];
+            tables.BuildPermutation(C, D, 0, perm);
+
+            uint32_t slot = (clk & 0x7F) >> 1;
+            size_t blockCount = 64 - slot < count ? 64 - slot : count;
+            for (size_t i = 0; i < blockCount; i++, slot++)
+            {
+                uint32_t z = (((slot >> 1) + A) & 0x1F) ^ m_B;
+                uint8_t channel = tables.Channel(perm[z] + F);
+                channels[i] = map.IsUsed(channel) ? channel : map.Remap(perm[z] + Fprime);
+            }
+            channels += blockCount;
+            count -= blockCount;
+            clk = (clk + 2 * static_cast<uint32_t>(blockCount)) & CLOCK_MASK;
+        }
+    }
+
+    // the adapted channel of the one slot at clk
+    uint8_t AdaptedChannel(uint32_t clk, const ChannelMap& map) const
+    {
+        const SelectionKernelTables& tables = SelectionKernelTables::Get();
+        uint32_t block = (clk & CLOCK_MASK) >> 7;
+        uint8_t z = static_cast<uint8_t>((((clk >> 2) + (m_A ^ (block >> 14))) & 0x1F) ^ m_B);
+        uint8_t perm = tables.Perm(z, (m_C ^ (block >> 9)) & 0x1F, (m_D ^ block) & 0x1FF, 0);
+        uint8_t channel = tables.Channel(perm + m_E + (16 * block) % SelectionKernelTables::CHANNEL_COUNT);
+        return map.IsUsed(channel) ? channel : map.Remap(perm + m_E + (16 * block) % map.UsedCount());
+    }
+
+    // the basic channel of the one slot at clk
+    uint8_t BasicChannel(uint32_t clk) const
+    {
+        uint32_t block = (clk & CLOCK_MASK) >> 7;
+        uint8_t Y1 = (clk >> 1) & 1;
+        return SelectionKernel((clk >> 2) & 0x1F, (m_A ^ (block >> 14)) & 0x1F, m_B, (m_C ^ (block >> 9)) & 0x1F, (m_D ^ block) & 0x1FF,
+            m_E, static_cast<uint8_t>((16 * block) % SelectionKernelTables::CHANNEL_COUNT), Y1, static_cast<uint8_t>(32 * Y1));
+    }
+
+private:
+    uint32_t m_address;
+    uint8_t m_A;
+    uint8_t m_B;
+    uint8_t m_C;
+    uint16_t m_D;
+    uint8_t m_E;
+    uint8_t m_channels[2][32];
+};
@@ -1,7 +1,30 @@
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
 #include <vector>
 
+// Serial keeps one uint32_t per register and walks the input lists for every bit.
+// WordParallel packs the register into one word and applies the Galois feedback
+// as a single mask XOR, producing bit identical output.
+// ByteTable is WordParallel plus lookup tables built from the configured polys,
+// advancing 8 bits and emitting a whole output byte per step when byte aligned.
+enum class LfsrEngine
+{
+    Serial,
+    WordParallel,
+    ByteTable,
+};
+
+inline uint32_t Parity32(uint32_t value)
+{
+    value ^= value >> 16;
+    value ^= value >> 8;
+    value ^= value >> 4;
+    value ^= value >> 2;
+    value ^= value >> 1;
+    return value & 1;
+}
+
 struct GeneratorState
 {
     GeneratorState()
@@ -23,10 +46,15 @@ struct GeneratorState
 class LinearFeedbackShiftRegister
 {
 public:
-    LinearFeedbackShiftRegister(uint32_t registerCount, uint32_t initState)
+    LinearFeedbackShiftRegister(uint32_t registerCount, uint32_t initState, LfsrEngine engine = LfsrEngine::ByteTable)
     {
+        m_engine = engine;
         m_registerCount = registerCount;
         m_DataInputPoly = 0;
+        m_feedbackMask = 0;
+        m_state = 0;
+        m_byteTablesValid = false;
+        m_jumpTableValid = false;
         m_registerInputs.resize(m_registerCount);
         m_nextStates.resize(m_registerCount);
         m_states.resize(m_registerCount);
@@ -35,6 +63,7 @@ public:
         {
             m_registerCount = sizeof(m_initState) * 8;
         }
+        m_registerMask = (m_registerCount < 32) ? ((1u << m_registerCount) - 1) : 0xFFFFFFFF;
 
         for (uint32_t i = 0; i < m_registerCount; i++)
         {
@@ -68,6 +97,9 @@ public:
                 m_registerInputs[i].push_back(m_registerCount-1);
             }
         }
+        m_feedbackMask ^= poly & m_registerMask;
+        m_byteTablesValid = false;
+        m_jumpTableValid = false;
     }
 
     void AddGeneratorPoly(uint32_t poly)
@@ -84,15 +116,25 @@ public:
                 genIn.push_back(i);
             }
         }
+        // a tap on register m_registerCount reads past the register, treat it as zero
+        m_generatorMasks.push_back(poly & m_registerMask);
+        m_byteOut.push_back(0);
+        m_byteTablesValid = false;
     }
 
     void AddInputPoly(uint32_t poly)
     {
         m_DataInputPoly = poly;
+        m_byteTablesValid = false;
     }
 
     void Shift(uint32_t bitCount = 1, const std::vector<uint8_t>& dataPayload = {})
     {
+        if (m_engine != LfsrEngine::Serial)
+        {
+            ShiftWord(bitCount, dataPayload);
+            return;
+        }
         for (uint32_t i = 0; i < bitCount; i++, m_DataBitIndex++)
         {
             for (uint32_t regIndex = 0; regIndex < m_registerCount; regIndex++)
@@ -103,39 +145,109 @@ public:
             {
                 std::vector<uint32_t>& genIn = m_GeneratorInputs[genIndex];
 
+                uint32_t genBit = 0;
                 for (uint32_t regIndex = 0; regIndex < genIn.size(); regIndex++)
                 {
-                    m_genOut[genIndex].m_workByte ^= m_states[genIn[regIndex]] ? m_BitShiftValue : 0;
+                    genBit ^= m_states[genIn[regIndex]] ? 1 : 0;
                 }
+                PushGeneratorBit(m_genOut[genIndex], genBit);
+            }
+//            uint32_t stateVal = GetState();
+            for (uint32_t regIndex = 0; regIndex < m_registerCount; regIndex++)
+            {
+                m_states[regIndex] = m_nextStates[regIndex];
+            }
+//            uint32_t nextStateVal = GetState();
+//            printf("stateChange %u %08X -> %08X \n", (dataPayload[m_DataBitIndex / 8] >> (m_DataBitIndex & 0x7)) & 1, stateVal, nextStateVal);
+        }
+    }
 
-                if (m_genOut[genIndex].m_bitIndex < 7)
+    void ShiftWord(uint32_t bitCount, const std::vector<uint8_t>& dataPayload)
+    {
+        const uint32_t inputMask = m_DataInputPoly & m_registerMask;
+        const size_t genCount = m_generatorMasks.size();
+        uint32_t state = m_state;
+        uint32_t i = 0;
+
+        if (m_engine == LfsrEngine::ByteTable && CanShiftBytes())
+        {
+            if (m_byteTablesValid == false)
+            {
+                BuildByteTables();
+            }
+            const uint32_t chunkCount = (m_registerCount + 7) / 8;
+            for (; i + 8 <= bitCount; i += 8, m_DataBitIndex += 8)
+            {
+                uint32_t inputByte = 0;
+                uint32_t byteIndex = m_DataBitIndex / 8;
+                if (inputMask != 0 && byteIndex < dataPayload.size())
                 {
-                    m_genOut[genIndex].m_bitIndex++;
-                    if (m_rightShift)
-                    {
-                        m_genOut[genIndex].m_workByte >>= 1;
-                    }
-                    else
+                    inputByte = dataPayload[byteIndex];
+                }
+
+                uint32_t nextState = m_inputStepTable[inputByte];
+                for (size_t genIndex = 0; genIndex < genCount; genIndex++)
+                {
+                    m_byteOut[genIndex] = m_inputOutTable[inputByte * genCount + genIndex];
+                }
+                for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+                {
+                    uint32_t tableIndex = chunk * 256 + ((state >> (chunk * 8)) & 0xFF);
+                    nextState ^= m_stateStepTable[tableIndex];
+                    for (size_t genIndex = 0; genIndex < genCount; genIndex++)
                     {
-                        m_genOut[genIndex].m_workByte <<= 1;
+                        m_byteOut[genIndex] ^= m_stateOutTable[tableIndex * genCount + genIndex];
                     }
                 }
-                else
+                for (size_t genIndex = 0; genIndex < genCount; genIndex++)
                 {
-                    m_genOut[genIndex].m_dataOut.push_back(m_genOut[genIndex].m_workByte);
-                    m_genOut[genIndex].m_bitIndex = 0;
-                    m_genOut[genIndex].m_workByte = 0;
+                    m_genOut[genIndex].m_dataOut.push_back(m_byteOut[genIndex]);
                 }
+                state = nextState;
+            }
+        }
 
+        for (; i < bitCount; i++, m_DataBitIndex++)
+        {
+            for (size_t genIndex = 0; genIndex < genCount; genIndex++)
+            {
+                PushGeneratorBit(m_genOut[genIndex], Parity32(state & m_generatorMasks[genIndex]));
             }
-//            uint32_t stateVal = GetState();
-            for (uint32_t regIndex = 0; regIndex < m_registerCount; regIndex++)
+
+            uint32_t dataBit = 0;
+            if (inputMask != 0)
             {
-                m_states[regIndex] = m_nextStates[regIndex];
+                uint32_t byteIndex = m_DataBitIndex / 8;
+                if (byteIndex < dataPayload.size())
+                {
+                    dataBit = (dataPayload[byteIndex] >> (m_DataBitIndex & 0x7)) & 1;
+                }
+            }
+            state = StepWord(state, dataBit);
+        }
+        m_state = state;
+    }
+
+    // Advances the register by bitCount steps as if the input bits were zero, in
+    // O(log bitCount) using precomputed powers of the transition matrix. No
+    // generator output is produced for the skipped bits.
+    void JumpAhead(uint64_t bitCount)
+    {
+        if (m_jumpTableValid == false)
+        {
+            BuildJumpTable();
+        }
+        uint32_t state = GetWordState();
+        uint64_t remaining = bitCount;
+        for (uint32_t power = 0; remaining != 0; power++, remaining >>= 1)
+        {
+            if (remaining & 1)
+            {
+                state = ApplyMatrix(&m_jumpTable[power * m_registerCount], state);
             }
-//            uint32_t nextStateVal = GetState();
-//            printf("stateChange %u %08X -> %08X \n", (dataPayload[m_DataBitIndex / 8] >> (m_DataBitIndex & 0x7)) & 1, stateVal, nextStateVal);
         }
+        SetWordState(state);
+        m_DataBitIndex += static_cast<uint32_t>(bitCount);
     }
 
     uint32_t XorInputs(uint32_t regIndex, const std::vector<uint8_t>& dataPayload = {})
@@ -184,6 +296,7 @@ public:
                 m_states[i] = (m_initState >> i) & 1;
                 m_nextStates[i] = 0;
             }
+            m_state = m_initState & m_registerMask;
         }
     }
     size_t GetGeneratorCount() { return m_genOut.size(); }
@@ -191,8 +304,20 @@ public:
     uint8_t GetBitShiftValue() { return m_BitShiftValue;}
     void SetBitShiftValue(uint8_t val) { m_BitShiftValue = val; }
 
+    LfsrEngine GetEngine() { return m_engine; }
+
     uint32_t GetState()
     {
+        if (m_engine != LfsrEngine::Serial)
+        {
+            // same ordering as the serial engine, register 0 ends up in the top bit
+            uint32_t stateVal = 0;
+            for (uint32_t i = 0; i < m_registerCount; i++)
+            {
+                stateVal = (stateVal << 1) | ((m_state >> i) & 1);
+            }
+            return stateVal;
+        }
         uint32_t stateVal = 0;
         uint32_t shiftInBit = 1 << (m_registerCount - 1);
         for (size_t i = 0; i < m_registerCount; i++)
@@ -204,6 +329,151 @@ public:
     }
 
 private:
+    uint32_t StepWord(uint32_t state, uint32_t dataBit)
+    {
+        uint32_t feedback = (state >> (m_registerCount - 1)) & 1;
+        state = ((state << 1) & m_registerMask) ^ (m_feedbackMask & (0 - feedback));
+        return state ^ (m_DataInputPoly & m_registerMask & (0 - dataBit));
+    }
+
+    uint32_t GetWordState()
+    {
+        if (m_engine != LfsrEngine::Serial)
+        {
+            return m_state;
+        }
+        uint32_t state = 0;
+        for (uint32_t i = 0; i < m_registerCount; i++)
+        {
+            state |= (m_states[i] & 1) << i;
+        }
+        return state;
+    }
+
+    void SetWordState(uint32_t state)
+    {
+        m_state = state;
+        for (uint32_t i = 0; i < m_registerCount; i++)
+        {
+            m_states[i] = (state >> i) & 1;
+        }
+    }
+
+    // column j of the matrix is the image of register j alone
+    uint32_t ApplyMatrix(const uint32_t* columns, uint32_t state)
+    {
+        uint32_t result = 0;
+        for (uint32_t j = 0; state != 0; j++, state >>= 1)
+        {
+            result ^= columns[j] & (0 - (state & 1));
+        }
+        return result;
+    }
+
+    // m_jumpTable holds the transition matrix raised to 2^power for every power a
+    // uint64_t bit count can need, each squared from the one before.
+    void BuildJumpTable()
+    {
+        const uint32_t n = m_registerCount;
+        m_jumpTable.assign(64 * n, 0);
+        for (uint32_t j = 0; j < n; j++)
+        {
+            m_jumpTable[j] = StepWord(1u << j, 0);
+        }
+        for (uint32_t power = 1; power < 64; power++)
+        {
+            const uint32_t* prev = &m_jumpTable[(power - 1) * n];
+            for (uint32_t j = 0; j < n; j++)
+            {
+                m_jumpTable[power * n + j] = ApplyMatrix(prev, prev[j]);
+            }
+        }
+        m_jumpTableValid = true;
+    }
+
+    // the byte tables only hold when the next output and input bits start a new byte
+    bool CanShiftBytes()
+    {
+        if (m_BitShiftValue != 0x80 || m_rightShift == false || (m_DataBitIndex & 0x7) != 0)
+        {
+            return false;
+        }
+        for (size_t genIndex = 0; genIndex < m_genOut.size(); genIndex++)
+        {
+            if (m_genOut[genIndex].m_bitIndex != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The register is linear, so 8 steps from (state, input byte) split into the
+    // XOR of 8 steps from each state byte with zero input and 8 steps from a zero
+    // state with the input byte. One table per state byte plus one for the input.
+    void BuildByteTables()
+    {
+        const uint32_t chunkCount = (m_registerCount + 7) / 8;
+        const size_t genCount = m_generatorMasks.size();
+        m_stateStepTable.assign(chunkCount * 256, 0);
+        m_stateOutTable.assign(chunkCount * 256 * genCount, 0);
+        m_inputStepTable.assign(256, 0);
+        m_inputOutTable.assign(256 * genCount, 0);
+
+        for (uint32_t chunk = 0; chunk <= chunkCount; chunk++)
+        {
+            const bool inputTable = chunk == chunkCount;
+            for (uint32_t value = 0; value < 256; value++)
+            {
+                uint32_t state = inputTable ? 0 : ((value << (chunk * 8)) & m_registerMask);
+                uint32_t tableIndex = inputTable ? value : chunk * 256 + value;
+                uint8_t* outBytes = inputTable ? &m_inputOutTable[tableIndex * genCount] : &m_stateOutTable[tableIndex * genCount];
+                for (uint32_t bit = 0; bit < 8; bit++)
+                {
+                    for (size_t genIndex = 0; genIndex < genCount; genIndex++)
+                    {
+                        outBytes[genIndex] |= Parity32(state & m_generatorMasks[genIndex]) << bit;
+                    }
+                    state = StepWord(state, inputTable ? ((value >> bit) & 1) : 0);
+                }
+                if (inputTable)
+                {
+                    m_inputStepTable[value] = state;
+                }
+                else
+                {
+                    m_stateStepTable[tableIndex] = state;
+                }
+            }
+        }
+        m_byteTablesValid = true;
+    }
+
+    void PushGeneratorBit(GeneratorState& gen, uint32_t bit)
+    {
+        gen.m_workByte ^= bit ? m_BitShiftValue : 0;
+
+        if (gen.m_bitIndex < 7)
+        {
+            gen.m_bitIndex++;
+            if (m_rightShift)
+            {
+                gen.m_workByte >>= 1;
+            }
+            else
+            {
+                gen.m_workByte <<= 1;
+            }
+        }
+        else
+        {
+            gen.m_dataOut.push_back(gen.m_workByte);
+            gen.m_bitIndex = 0;
+            gen.m_workByte = 0;
+        }
+    }
+
+    LfsrEngine m_engine;
     uint8_t m_BitShiftValue;
     bool m_rightShift;
     uint32_t m_registerCount;
@@ -220,5 +490,23 @@ private:
     std::vector<uint32_t> m_states;
     std::vector<uint32_t> m_nextStates;
     std::vector<GeneratorState> m_genOut;
+
+    // WordParallel engine, bit i of each word is register i
+    uint32_t m_state;
+    uint32_t m_registerMask;
+    uint32_t m_feedbackMask;
+    std::vector<uint32_t> m_generatorMasks;
+
+    // ByteTable engine
+    bool m_byteTablesValid;
+    std::vector<uint32_t> m_stateStepTable;
+    std::vector<uint8_t> m_stateOutTable;
+    std::vector<uint32_t> m_inputStepTable;
+    std::vector<uint8_t> m_inputOutTable;
+    std::vector<uint8_t> m_byteOut;
+
+    // JumpAhead, usable from every engine
+    bool m_jumpTableValid;
+    std::vector<uint32_t> m_jumpTable;
 };
 
@@ -0,0 +1,136 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Read only view of a whole file, mapped rather than read so multi GB
+// captures are used in place and paged in as they are walked front to back.
+// The kernel is told the access is sequential so it reads ahead and drops
+// pages behind. An empty file opens fine with a null Data().
+class MappedFile
+{
+public:
+    MappedFile()
+        :m_data(nullptr),
+        m_size(0)
+    {
+#ifdef _WIN32
+        m_file = INVALID_HANDLE_VALUE;
+        m_mapping = nullptr;
+#endif
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const char* path)
+    {
+        Close();
+#ifdef _WIN32
+        m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(m_file, &fileSize) == FALSE)
+        {
+            Close();
+            return false;
+        }
+        m_size = static_cast<size_t>(fileSize.QuadPart);
+        if (m_size != 0)
+        {
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            m_data = m_mapping != nullptr ? static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            if (m_data == nullptr)
+            {
+                Close();
+                return false;
+            }
+        }
+#else
+        int file = open(path, O_RDONLY);
+        if (file < 0)
+        {
+            return false;
+        }
+        struct stat fileStat;
+        if (fstat(file, &fileStat) != 0 || S_ISREG(fileStat.st_mode) == false)
+        {
+            close(file);
+            return false;
+        }
+        m_size = static_cast<size_t>(fileStat.st_size);
+        if (m_size != 0)
+        {
+            void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapping == MAP_FAILED)
+            {
+                close(file);
+                m_size = 0;
+                return false;
+            }
+            madvise(mapping, m_size, MADV_SEQUENTIAL);
+            m_data = static_cast<const uint8_t*>(mapping);
+        }
+        // the mapping keeps the file open
+        close(file);
+#endif
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (m_data != nullptr)
+        {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping != nullptr)
+        {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+        }
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+            m_file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (m_data != nullptr)
+        {
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+        }
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const uint8_t* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+};
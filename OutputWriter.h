@@ -0,0 +1,190 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+enum class Verbosity
+{
+    Quiet,      // results only, nothing per record
+    Normal,     // a line per record as well
+};
+
+// Buffered text and binary output. Everything goes into one fixed buffer that
+// is handed to fwrite when full, so bulk output is a few large writes instead
+// of a printf per byte. Hex bytes come three characters at a time out of one
+// table, numbers are formatted by hand. Output written straight to the same
+// FILE with printf in between would overtake what is still buffered here, so
+// Flush first.
+class OutputWriter
+{
+public:
+    static const size_t DEFAULT_BUFFER_SIZE = 1 << 16;
+
+    OutputWriter(FILE* output, size_t bufferSize = DEFAULT_BUFFER_SIZE)
+        :m_output(output),
+        m_buffer(bufferSize >= MIN_BUFFER_SIZE ? bufferSize : MIN_BUFFER_SIZE),
+        m_used(0),
+        m_flushed(0)
+    {
+    }
+
+    ~OutputWriter()
+    {
+        Flush();
+    }
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    void Write(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        if (m_used + size > m_buffer.size())
+        {
+            Flush();
+            if (size > m_buffer.size())
+            {
+                fwrite(bytes, 1, size, m_output);
+                m_flushed += size;
+                return;
+            }
+        }
+        memcpy(&m_buffer[m_used], bytes, size);
+        m_used += size;
+    }
+
+    void Text(const char* text)
+    {
+        Write(text, strlen(text));
+    }
+
+    void Char(char c)
+    {
+        Reserve(1)[0] = static_cast<uint8_t>(c);
+        m_used++;
+    }
+
+    // value as a fixed number of upper case hex digits, leading zeros kept
+    void Hex(uint64_t value, uint32_t digits)
+    {
+        const char* table = HexTable::Get().digits;
+        uint8_t* out = Reserve(digits);
+        for (uint32_t i = 0; i < digits; i++)
+        {
+            out[i] = table[(value >> (4 * (digits - 1 - i))) & 0xF];
+        }
+        m_used += digits;
+    }
+
+    // "XX " per byte, the hex text the tools exchange
+    void HexBytes(const uint8_t* data, size_t size)
+    {
+        const HexTable& table = HexTable::Get();
+        while (size != 0)
+        {
+            size_t room = (m_buffer.size() - m_used) / 3;
+            if (room == 0)
+            {
+                Flush();
+                continue;
+            }
+            size_t count = size < room ? size : room;
+            uint8_t* out = &m_buffer[m_used];
+            for (size_t i = 0; i < count; i++)
+            {
+                memcpy(out + 3 * i, table.bytes[data[i]], 3);
+            }
+            m_used += 3 * count;
+            data += count;
+            size -= count;
+        }
+    }
+
+    void Decimal(uint64_t value)
+    {
+        char digits[20];
+        uint32_t count = 0;
+        do
+        {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        uint8_t* out = Reserve(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            out[i] = static_cast<uint8_t>(digits[count - 1 - i]);
+        }
+        m_used += count;
+    }
+
+    // count bits of value as 0 and 1, bit 0 first
+    void Bits(uint32_t value, uint32_t count)
+    {
+        uint8_t* out = Reserve(count);
+        for (uint32_t bit = 0; bit < count; bit++)
+        {
+            out[bit] = static_cast<uint8_t>('0' + ((value >> bit) & 1));
+        }
+        m_used += count;
+    }
+
+    // bytes written so far, buffered or not
+    uint64_t Written() const
+    {
+        return m_flushed + m_used;
+    }
+
+    void Flush()
+    {
+        if (m_used != 0)
+        {
+            fwrite(m_buffer.data(), 1, m_used, m_output);
+            m_flushed += m_used;
+            m_used = 0;
+        }
+        fflush(m_output);
+    }
+
+private:
+    // room for the longest single field
+    static const size_t MIN_BUFFER_SIZE = 64;
+
+    struct HexTable
+    {
+        static const HexTable& Get()
+        {
+            static const HexTable table;
+            return table;
+        }
+
+        HexTable()
+        {
+            memcpy(digits, "0123456789ABCDEF", 16);
+            for (uint32_t value = 0; value < 256; value++)
+            {
+                bytes[value][0] = digits[value >> 4];
+                bytes[value][1] = digits[value & 0xF];
+                bytes[value][2] = ' ';
+            }
+        }
+
+        char digits[16];
+        char bytes[256][3];
+    };
+
+    uint8_t* Reserve(size_t size)
+    {
+        if (m_used + size > m_buffer.size())
+        {
+            Flush();
+        }
+        return &m_buffer[m_used];
+    }
+
+    FILE* m_output;
+    std::vector<uint8_t> m_buffer;
+    size_t m_used;
+    uint64_t m_flushed;
+};
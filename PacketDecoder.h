@@ -0,0 +1,326 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "BluetoothWhitening.h"
+#include "BluetoothHec.h"
+#include "BluetoothCrc.h"
+#include "BluetoothFec13.h"
+#include "BluetoothFec23.h"
+
+// Everything PacketDecoder::Decode learns about one packet. payload points into
+// the decoder and stays valid until its next Decode call.
+struct DecodedPacket
+{
+    bool syncFound;
+    // bit offset of the sync word in the raw buffer and its bit errors
+    size_t syncOffset;
+    uint32_t syncErrors;
+
+    // dewhitened header bits 0 - 17 in the WhitenData layout, HEC in bits 10 - 17
+    uint32_t header;
+    // bit n set when all three FEC 1/3 copies of header bit n agreed
+    uint32_t headerUnanimous;
+    bool hecValid;
+    uint8_t ltAddr;
+    uint8_t type;
+    uint8_t flow;
+    uint8_t arqn;
+    uint8_t seqn;
+
+    // false for the voice and eSCO types, their payload is not decoded
+    bool payloadSupported;
+    // the payload was fully inside the raw buffer and its length field in range
+    bool payloadComplete;
+    uint8_t llid;
+    uint8_t payloadFlow;
+    uint16_t length;
+    // dewhitened payload header and body, without the CRC
+    const uint8_t* payload;
+    size_t payloadSize;
+    size_t bodyOffset;
+    bool hasCrc;
+    bool crcValid;
+    size_t fecCorrected;
+    size_t fecUncorrectable;
+};
+
+// Decodes BR ACL packets from raw demodulated bits in one pass: finds the sync
+// word of the LAP, majority decodes and dewhitens the header, checks the HEC,
+// then FEC 2/3 decodes, dewhitens and CRC checks the payload. Raw bits are
+// packed first bit in bit 0. The decoder owns its buffers, sized once for the
+// largest packet, so decoding allocates nothing.
+class PacketDecoder
+{
+public:
+    static const uint32_t SYNC_WORD_BITS = 64;
+    static const uint32_t TRAILER_BITS = 4;
+    static const uint32_t MAX_PAYLOAD_BITS = (2 + 339 + 2) * 8;
+    static const uint32_t MAX_CODED_BITS = (MAX_PAYLOAD_BITS + 9) / 10 * BluetoothFec23::BLOCK_BITS;
+    static const uint32_t DEFAULT_MAX_SYNC_ERRORS = 5;
+
+    PacketDecoder(uint32_t lap, uint8_t uap, uint32_t maxSyncErrors = DEFAULT_MAX_SYNC_ERRORS)
+        :fec23(BluetoothFec23::Get()),
+        crc16(BluetoothCrc16::Get()),
+        hecTable(BluetoothHecTable::Get()),
+        m_uap(uap),
+        m_maxSyncErrors(maxSyncErrors),
+        m_coded((MAX_CODED_BITS + 7) / 8),
+        m_payload((MAX_CODED_BITS + 7) / 8)
+    {
+        m_syncWord = SyncWord(lap);
+    }
+
+    // The 64 bit sync word of a LAP, bit n being sync word bit n, sent first to
+    // last. 30 information bits, the LAP and a Barker code picked by its top
+    // bit, are scrambled by the top of the PN sequence and extended by the
+    // BCH(64,30) code, then the whole word is scrambled by the PN sequence.
+    static uint64_t SyncWord(uint32_t lap)
+    {
+        const uint64_t pn = 0x83848D96BBCC54FCULL;
+        // octal 260534236651
+        const uint64_t bchPoly = 0x585713DA9ULL;
+        const uint64_t barker = (lap & 0x800000) ? 0x13 : 0x2C;
+
+        uint64_t info = ((lap & 0xFFFFFF) | barker << 24) ^ (pn >> 34);
+        uint64_t remainder = info << 34;
+        for (uint32_t bit = 63; bit >= 34; bit--)
+        {
+            if ((remainder >> bit) & 1)
+            {
+                remainder ^= bchPoly << (bit - 34);
+            }
+        }
+        return ((info << 34) | remainder) ^ pn;
+    }
+
+    uint64_t GetSyncWord() const { return m_syncWord; }
+
+    // the payload of the header TYPE ends in a CRC
+    static bool TypeHasCrc(uint8_t type) { return GetPayloadFormat(type).crc; }
+
+    // Decodes the first packet in bitCount raw bits, clock being the clock of
+    // its slot. Returns true when the sync word, HEC and any CRC all check out.
+    bool Decode(const uint8_t* bits, size_t bitCount, uint32_t clock, DecodedPacket& packet)
+    {
+        packet = DecodedPacket();
+        if (FindSync(bits, bitCount, packet) == false)
+        {
+            return false;
+        }
+
+        const size_t headerStart = packet.syncOffset + SYNC_WORD_BITS + TRAILER_BITS;
+        if (headerStart + BluetoothFec13::CODED_BITS > bitCount)
+        {
+            return false;
+        }
+        BluetoothWhitening whitening(clock);
+        uint8_t header[BluetoothFec13::HEADER_BYTES];
+        CopyBits(bits, headerStart, BluetoothFec13::CODED_BITS, m_coded.data());
+        BluetoothFec13::Decode(m_coded.data(), header, packet.headerUnanimous);
+        whitening.WhitenData(header, sizeof(header));
+        packet.header = header[0] | header[1] << 8 | header[2] << 16;
+        packet.hecValid = hecTable.Calc(m_uap, packet.header & BluetoothHecTable::HEADER_MASK) == (packet.header >> 10);
+        packet.ltAddr = packet.header & 0x7;
+        packet.type = (packet.header >> 3) & 0xF;
+        packet.flow = (packet.header >> 7) & 1;
+        packet.arqn = (packet.header >> 8) & 1;
+        packet.seqn = (packet.header >> 9) & 1;
+        if (packet.hecValid == false)
+        {
+            return false;
+        }
+
+        const PayloadFormat& format = GetPayloadFormat(packet.type);
+        packet.payloadSupported = format.supported;
+        packet.payload = m_payload.data();
+        if (format.supported == false)
+        {
+            return true;
+        }
+        if (format.headerBits == 0 && format.fixedBits == 0)
+        {
+            packet.payloadComplete = true;
+            return true;
+        }
+        return DecodePayload(bits, bitCount, headerStart + BluetoothFec13::CODED_BITS, whitening, format, packet);
+    }
+
+private:
+    struct PayloadFormat
+    {
+        bool supported;
+        bool fec23;
+        bool crc;
+        // payload header bits, 0 for no payload header
+        uint8_t headerBits;
+        uint16_t maxLength;
+        // data bits of payloads without a payload header, before the CRC
+        uint16_t fixedBits;
+    };
+
+    // ACL packet types of a BR link by header TYPE
+    static const PayloadFormat& GetPayloadFormat(uint8_t type)
+    {
+        static const PayloadFormat formats[16] =
+        {
+            { true, false, false, 0, 0, 0 },        // NULL
+            { true, false, false, 0, 0, 0 },        // POLL
+            { true, true, true, 0, 0, 144 },        // FHS
+            { true, true, true, 8, 17, 0 },         // DM1
+            { true, false, true, 8, 27, 0 },        // DH1
+            { false, false, false, 0, 0, 0 },       // HV1
+            { false, false, false, 0, 0, 0 },       // HV2
+            { false, false, false, 0, 0, 0 },       // HV3
+            { false, false, false, 0, 0, 0 },       // DV
+            { true, false, false, 8, 29, 0 },       // AUX1
+            { true, true, true, 16, 121, 0 },       // DM3
+            { true, false, true, 16, 183, 0 },      // DH3
+            { false, false, false, 0, 0, 0 },       // EV4
+            { false, false, false, 0, 0, 0 },       // EV5
+            { true, true, true, 16, 224, 0 },       // DM5
+            { true, false, true, 16, 339, 0 },      // DH5
+        };
+        return formats[type & 0xF];
+    }
+
+    static uint32_t PopCount64(uint64_t bits)
+    {
+        bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+        bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+        bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return static_cast<uint32_t>((bits * 0x0101010101010101ULL) >> 56);
+    }
+
+    // slides a 64 bit window over the raw bits, one bit per step
+    bool FindSync(const uint8_t* bits, size_t bitCount, DecodedPacket& packet) const
+    {
+        if (bitCount < SYNC_WORD_BITS)
+        {
+            return false;
+        }
+        uint64_t window = 0;
+        for (uint32_t bit = 0; bit < SYNC_WORD_BITS; bit++)
+        {
+            window |= static_cast<uint64_t>((bits[bit >> 3] >> (bit & 7)) & 1) << bit;
+        }
+        for (size_t offset = 0; ; offset++)
+        {
+            uint32_t errors = PopCount64(window ^ m_syncWord);
+            if (errors <= m_maxSyncErrors)
+            {
+                packet.syncFound = true;
+                packet.syncOffset = offset;
+                packet.syncErrors = errors;
+                return true;
+            }
+            size_t next = offset + SYNC_WORD_BITS;
+            if (next >= bitCount)
+            {
+                return false;
+            }
+            window = (window >> 1) | static_cast<uint64_t>((bits[next >> 3] >> (next & 7)) & 1) << 63;
+        }
+    }
+
+    // bitCount bits from bitOffset to the start of dataOut, the last byte zero padded
+    static void CopyBits(const uint8_t* dataIn, size_t bitOffset, size_t bitCount, uint8_t* dataOut)
+    {
+        const uint8_t* source = dataIn + (bitOffset >> 3);
+        const uint32_t shift = bitOffset & 7;
+        const size_t byteCount = (bitCount + 7) / 8;
+        // the source byte after the last one needed may be past the buffer
+        const size_t sourceBytes = (shift + bitCount + 7) / 8;
+        for (size_t i = 0; i < byteCount; i++)
+        {
+            uint32_t bitsIn = source[i] >> shift;
+            if (shift != 0 && i + 1 < sourceBytes)
+            {
+                bitsIn |= source[i + 1] << (8 - shift);
+            }
+            dataOut[i] = bitsIn & 0xFF;
+        }
+        if (bitCount & 7)
+        {
+            dataOut[byteCount - 1] &= (1 << (bitCount & 7)) - 1;
+        }
+    }
+
+    static size_t CodedBits(const PayloadFormat& format, size_t dataBits)
+    {
+        return format.fec23 ? (dataBits + 9) / 10 * BluetoothFec23::BLOCK_BITS : dataBits;
+    }
+
+    // data bits from coded bits at payloadStart into m_payload, still whitened
+    void ExtractPayload(const uint8_t* bits, size_t payloadStart, const PayloadFormat& format, size_t dataBits, DecodedPacket& packet)
+    {
+        if (format.fec23)
+        {
+            size_t blockCount = (dataBits + 9) / 10;
+            CopyBits(bits, payloadStart, blockCount * BluetoothFec23::BLOCK_BITS, m_coded.data());
+            packet.fecUncorrectable = fec23.Decode(m_coded.data(), blockCount, m_payload.data(), &packet.fecCorrected);
+        }
+        else
+        {
+            CopyBits(bits, payloadStart, dataBits, m_payload.data());
+        }
+    }
+
+    bool DecodePayload(const uint8_t* bits, size_t bitCount, size_t payloadStart, BluetoothWhitening& whitening, const PayloadFormat& format, DecodedPacket& packet)
+    {
+        size_t dataBits = format.fixedBits;
+        if (format.headerBits != 0)
+        {
+            // the payload header gives the length of the rest
+            if (payloadStart + CodedBits(format, format.headerBits) > bitCount)
+            {
+                return false;
+            }
+            ExtractPayload(bits, payloadStart, format, format.headerBits, packet);
+            uint8_t payloadHeader[2];
+            whitening.WhitenPayload(m_payload.data(), payloadHeader, format.headerBits / 8);
+            packet.llid = payloadHeader[0] & 0x3;
+            packet.payloadFlow = (payloadHeader[0] >> 2) & 1;
+            packet.length = payloadHeader[0] >> 3;
+            if (format.headerBits == 16)
+            {
+                packet.length |= (payloadHeader[1] & 0x1F) << 5;
+            }
+            if (packet.length > format.maxLength)
+            {
+                return false;
+            }
+            dataBits = format.headerBits + packet.length * 8;
+        }
+        dataBits += format.crc ? 16 : 0;
+        if (payloadStart + CodedBits(format, dataBits) > bitCount)
+        {
+            return false;
+        }
+
+        ExtractPayload(bits, payloadStart, format, dataBits, packet);
+        const size_t dataBytes = dataBits / 8;
+        whitening.WhitenPayload(m_payload.data(), m_payload.data(), dataBytes);
+        packet.payloadComplete = true;
+        packet.bodyOffset = format.headerBits / 8;
+        packet.payloadSize = dataBytes;
+        packet.hasCrc = format.crc;
+        if (format.crc)
+        {
+            packet.payloadSize -= 2;
+            uint16_t crcReceived = m_payload[packet.payloadSize] | m_payload[packet.payloadSize + 1] << 8;
+            packet.crcValid = crc16.Calc(m_uap, m_payload.data(), packet.payloadSize) == crcReceived;
+            return packet.crcValid;
+        }
+        return true;
+    }
+
+    const BluetoothFec23& fec23;
+    const BluetoothCrc16& crc16;
+    const BluetoothHecTable& hecTable;
+    uint8_t m_uap;
+    uint32_t m_maxSyncErrors;
+    uint64_t m_syncWord;
+    std::vector<uint8_t> m_coded;
+    std::vector<uint8_t> m_payload;
+};
@@ -0,0 +1,543 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// LINKTYPE_BLUETOOTH_BREDR_BB, the baseband packets Ubertooth and libbtbb write
+static const uint32_t LINKTYPE_BLUETOOTH_BREDR_BB = 255;
+
+// The pseudo header in front of every LINKTYPE_BLUETOOTH_BREDR_BB packet, all
+// fields low byte first. The BR or EDR payload follows it, ending in its CRC
+// when the packet type has one. packetHeader holds the 18 header bits in the
+// WhitenData layout, HEC in bits 10 - 17.
+struct BredrBbHeader
+{
+    static const size_t SIZE = 22;
+    static const uint16_t DEWHITENED = 0x0001;
+    static const uint16_t SIGNAL_POWER_VALID = 0x0002;
+    static const uint16_t NOISE_POWER_VALID = 0x0004;
+    static const uint16_t PAYLOAD_DECRYPTED = 0x0008;
+    static const uint16_t REFERENCE_LAP_VALID = 0x0010;
+    static const uint16_t PAYLOAD_PRESENT = 0x0020;
+    static const uint16_t CHANNEL_ALIASED = 0x0040;
+    static const uint16_t REFERENCE_UAP_VALID = 0x0080;
+    static const uint16_t HEC_CHECKED = 0x0100;
+    static const uint16_t HEC_VALID = 0x0200;
+    static const uint16_t CRC_CHECKED = 0x0400;
+    static const uint16_t CRC_VALID = 0x0800;
+    static const uint16_t MIC_CHECKED = 0x1000;
+    static const uint16_t MIC_VALID = 0x2000;
+
+    uint8_t rfChannel;
+    int8_t signalPower;
+    int8_t noisePower;
+    uint8_t accessCodeOffenses;
+    uint8_t payloadTransportRate;
+    uint8_t correctedHeaderBits;
+    int16_t correctedPayloadBits;
+    uint32_t lap;
+    uint32_t referenceLap;
+    uint8_t referenceUap;
+    uint32_t packetHeader;
+    uint16_t flags;
+
+    bool Parse(const uint8_t* data, size_t size)
+    {
+        if (size < SIZE)
+        {
+            return false;
+        }
+        rfChannel = data[0];
+        signalPower = static_cast<int8_t>(data[1]);
+        noisePower = static_cast<int8_t>(data[2]);
+        accessCodeOffenses = data[3];
+        payloadTransportRate = data[4];
+        correctedHeaderBits = data[5];
+        correctedPayloadBits = static_cast<int16_t>(data[6] | data[7] << 8);
+        lap = Load32(data + 8);
+        referenceLap = Load32(data + 12) & 0xFFFFFF;
+        referenceUap = data[15];
+        packetHeader = Load32(data + 16);
+        flags = static_cast<uint16_t>(data[20] | data[21] << 8);
+        return true;
+    }
+
+    void Write(uint8_t* out) const
+    {
+        out[0] = rfChannel;
+        out[1] = static_cast<uint8_t>(signalPower);
+        out[2] = static_cast<uint8_t>(noisePower);
+        out[3] = accessCodeOffenses;
+        out[4] = payloadTransportRate;
+        out[5] = correctedHeaderBits;
+        out[6] = static_cast<uint8_t>(correctedPayloadBits & 0xFF);
+        out[7] = static_cast<uint8_t>((correctedPayloadBits >> 8) & 0xFF);
+        Store32(out + 8, lap);
+        Store32(out + 12, (referenceLap & 0xFFFFFF) | static_cast<uint32_t>(referenceUap) << 24);
+        Store32(out + 16, packetHeader);
+        out[20] = static_cast<uint8_t>(flags & 0xFF);
+        out[21] = static_cast<uint8_t>(flags >> 8);
+    }
+
+private:
+    static uint32_t Load32(const uint8_t* data)
+    {
+        return data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24;
+    }
+
+    static void Store32(uint8_t* out, uint32_t value)
+    {
+        out[0] = static_cast<uint8_t>(value & 0xFF);
+        out[1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+        out[2] = static_cast<uint8_t>((value >> 16) & 0xFF);
+        out[3] = static_cast<uint8_t>(value >> 24);
+    }
+};
+
+// One captured packet. data points into the reader and stays valid until its
+// next Next call.
+struct PcapPacket
+{
+    uint64_t timestampNs;
+    uint32_t linkType;
+    uint32_t interfaceId;
+    const uint8_t* data;
+    size_t size;
+    size_t originalSize;
+};
+
+// Streams packets out of a pcap or pcapng file one record at a time, so only
+// the largest record is ever held in memory. pcap in either byte order with
+// microsecond or nanosecond timestamps is read, and pcapng with any number of
+// sections and interfaces, taking enhanced and simple packet blocks and
+// skipping every other block type.
+class PcapReader
+{
+public:
+    // larger records are taken as a damaged file
+    static const size_t MAX_RECORD_SIZE = 1 << 24;
+
+    PcapReader(FILE* input)
+        :m_input(input),
+        m_pcapng(false),
+        m_swapped(false),
+        m_linkType(0),
+        m_unitsPerSecond(1000000),
+        m_malformed(false)
+    {
+    }
+
+    // reads the file header, false when the input is neither format
+    bool Open()
+    {
+        uint8_t header[24];
+        if (Read(header, 4) == false)
+        {
+            return false;
+        }
+        const uint32_t magic = Load32(header, false);
+        if (magic == PCAPNG_SECTION_HEADER)
+        {
+            m_pcapng = true;
+            return Read(header + 4, 4) && ReadSectionHeader(header + 4);
+        }
+
+        m_pcapng = false;
+        m_swapped = magic == Swap32(PCAP_MAGIC_US) || magic == Swap32(PCAP_MAGIC_NS);
+        const uint32_t ordered = m_swapped ? Swap32(magic) : magic;
+        if (ordered != PCAP_MAGIC_US && ordered != PCAP_MAGIC_NS)
+        {
+            return false;
+        }
+        m_unitsPerSecond = ordered == PCAP_MAGIC_NS ? 1000000000 : 1000000;
+        if (Read(header + 4, 20) == false)
+        {
+            return false;
+        }
+        // the upper bits carry FCS information
+        m_linkType = Load32(header + 20, m_swapped) & 0xFFFF;
+        return true;
+    }
+
+    bool IsPcapng() const { return m_pcapng; }
+
+    // false at the end of the input, Malformed() tells a damaged record apart
+    bool Next(PcapPacket& packet)
+    {
+        return m_pcapng ? NextBlock(packet) : NextRecord(packet);
+    }
+
+    bool Malformed() const { return m_malformed; }
+
+private:
+    static const uint32_t PCAP_MAGIC_US = 0xA1B2C3D4;
+    static const uint32_t PCAP_MAGIC_NS = 0xA1B23C4D;
+    static const uint32_t PCAPNG_SECTION_HEADER = 0x0A0D0D0A;
+    static const uint32_t PCAPNG_BYTE_ORDER = 0x1A2B3C4D;
+    static const uint32_t PCAPNG_INTERFACE = 1;
+    static const uint32_t PCAPNG_SIMPLE_PACKET = 3;
+    static const uint32_t PCAPNG_ENHANCED_PACKET = 6;
+    static const uint16_t IF_TSRESOL = 9;
+
+    struct Interface
+    {
+        uint32_t linkType;
+        uint32_t snapLength;
+        uint64_t unitsPerSecond;
+    };
+
+    static uint32_t Swap32(uint32_t value)
+    {
+        return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+    }
+
+    static uint32_t Load32(const uint8_t* data, bool swapped)
+    {
+        uint32_t value = data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24;
+        return swapped ? Swap32(value) : value;
+    }
+
+    static uint16_t Load16(const uint8_t* data, bool swapped)
+    {
+        return static_cast<uint16_t>(swapped ? (data[0] << 8 | data[1]) : (data[0] | data[1] << 8));
+    }
+
+    static uint64_t ToNanoseconds(uint64_t time, uint64_t unitsPerSecond)
+    {
+        const uint64_t nsPerSecond = 1000000000;
+        if (unitsPerSecond > nsPerSecond)
+        {
+            // finer than a nanosecond, the remainder is dropped
+            return time / unitsPerSecond * nsPerSecond + time % unitsPerSecond / (unitsPerSecond / nsPerSecond);
+        }
+        return time / unitsPerSecond * nsPerSecond + time % unitsPerSecond * nsPerSecond / unitsPerSecond;
+    }
+
+    bool Read(void* data, size_t size)
+    {
+        return fread(data, 1, size, m_input) == size;
+    }
+
+    // false at a clean end of the input, otherwise the record is damaged
+    bool ReadBody(size_t size)
+    {
+        if (size > MAX_RECORD_SIZE)
+        {
+            m_malformed = true;
+            return false;
+        }
+        m_record.resize(size);
+        if (Read(m_record.data(), size) == false)
+        {
+            m_malformed = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool NextRecord(PcapPacket& packet)
+    {
+        uint8_t header[16];
+        size_t headerRead = fread(header, 1, sizeof(header), m_input);
+        if (headerRead != sizeof(header))
+        {
+            m_malformed = headerRead != 0;
+            return false;
+        }
+        const uint32_t captured = Load32(header + 8, m_swapped);
+        if (ReadBody(captured) == false)
+        {
+            return false;
+        }
+        packet.timestampNs = ToNanoseconds(static_cast<uint64_t>(Load32(header, m_swapped)) * m_unitsPerSecond + Load32(header + 4, m_swapped), m_unitsPerSecond);
+        packet.linkType = m_linkType;
+        packet.interfaceId = 0;
+        packet.data = m_record.data();
+        packet.size = captured;
+        packet.originalSize = Load32(header + 12, m_swapped);
+        return true;
+    }
+
+    // The rest of a section header block after its type and length, the
+    // length is only known once the byte order magic set the byte order.
+    bool ReadSectionHeader(const uint8_t* blockLengthField)
+    {
+        uint8_t order[4];
+        if (Read(order, sizeof(order)) == false)
+        {
+            m_malformed = true;
+            return false;
+        }
+        const uint32_t orderMagic = Load32(order, false);
+        if (orderMagic != PCAPNG_BYTE_ORDER && orderMagic != Swap32(PCAPNG_BYTE_ORDER))
+        {
+            m_malformed = true;
+            return false;
+        }
+        m_swapped = orderMagic != PCAPNG_BYTE_ORDER;
+        const uint32_t blockLength = Load32(blockLengthField, m_swapped);
+        if (blockLength < 28 || (blockLength & 3) != 0)
+        {
+            m_malformed = true;
+            return false;
+        }
+        m_interfaces.clear();
+        // version, section length and options are not needed
+        return ReadBody(blockLength - 12);
+    }
+
+    bool ReadInterface()
+    {
+        if (m_record.size() < 12)
+        {
+            m_malformed = true;
+            return false;
+        }
+        Interface iface;
+        iface.linkType = Load16(m_record.data(), m_swapped);
+        iface.snapLength = Load32(m_record.data() + 4, m_swapped);
+        iface.unitsPerSecond = 1000000;
+        size_t offset = 8;
+        while (offset + 4 <= m_record.size() - 4)
+        {
+            const uint16_t code = Load16(&m_record[offset], m_swapped);
+            const uint16_t length = Load16(&m_record[offset + 2], m_swapped);
+            if (code == 0)
+            {
+                break;
+            }
+            if (code == IF_TSRESOL && length >= 1 && offset + 5 <= m_record.size())
+            {
+                // a power of 10, or of 2 with the top bit set
+                const uint8_t resolution = m_record[offset + 4];
+                const uint32_t exponent = resolution & 0x7F;
+                uint64_t units = 1;
+                for (uint32_t i = 0; i < exponent && units < (1ULL << 56); i++)
+                {
+                    units *= (resolution & 0x80) ? 2 : 10;
+                }
+                iface.unitsPerSecond = units;
+            }
+            offset += 4 + ((length + 3) & ~3);
+        }
+        m_interfaces.push_back(iface);
+        return true;
+    }
+
+    bool NextBlock(PcapPacket& packet)
+    {
+        for (;;)
+        {
+            uint8_t header[8];
+            size_t headerRead = fread(header, 1, sizeof(header), m_input);
+            if (headerRead != sizeof(header))
+            {
+                m_malformed = headerRead != 0;
+                return false;
+            }
+            const uint32_t type = Load32(header, m_swapped);
+            if (type == PCAPNG_SECTION_HEADER)
+            {
+                // a new section, maybe in the other byte order
+                if (ReadSectionHeader(header + 4) == false)
+                {
+                    return false;
+                }
+                continue;
+            }
+            const uint32_t blockLength = Load32(header + 4, m_swapped);
+            if (blockLength < 12 || (blockLength & 3) != 0)
+            {
+                m_malformed = true;
+                return false;
+            }
+            // body and trailing length
+            if (ReadBody(blockLength - 8) == false)
+            {
+                return false;
+            }
+            const size_t bodySize = blockLength - 12;
+
+            if (type == PCAPNG_INTERFACE)
+            {
+                if (ReadInterface() == false)
+                {
+                    return false;
+                }
+            }
+            else if (type == PCAPNG_ENHANCED_PACKET)
+            {
+                if (bodySize < 20)
+                {
+                    m_malformed = true;
+                    return false;
+                }
+                const uint32_t interfaceId = Load32(m_record.data(), m_swapped);
+                const uint32_t captured = Load32(m_record.data() + 12, m_swapped);
+                if (interfaceId >= m_interfaces.size() || captured > bodySize - 20)
+                {
+                    m_malformed = true;
+                    return false;
+                }
+                const Interface& iface = m_interfaces[interfaceId];
+                const uint64_t time = static_cast<uint64_t>(Load32(m_record.data() + 4, m_swapped)) << 32 | Load32(m_record.data() + 8, m_swapped);
+                packet.timestampNs = ToNanoseconds(time, iface.unitsPerSecond);
+                packet.linkType = iface.linkType;
+                packet.interfaceId = interfaceId;
+                packet.data = m_record.data() + 20;
+                packet.size = captured;
+                packet.originalSize = Load32(m_record.data() + 16, m_swapped);
+                return true;
+            }
+            else if (type == PCAPNG_SIMPLE_PACKET)
+            {
+                if (bodySize < 4 || m_interfaces.empty())
+                {
+                    m_malformed = true;
+                    return false;
+                }
+                const Interface& iface = m_interfaces[0];
+                const uint32_t original = Load32(m_record.data(), m_swapped);
+                size_t captured = original < bodySize - 4 ? original : bodySize - 4;
+                if (iface.snapLength != 0 && captured > iface.snapLength)
+                {
+                    captured = iface.snapLength;
+                }
+                packet.timestampNs = 0;
+                packet.linkType = iface.linkType;
+                packet.interfaceId = 0;
+                packet.data = m_record.data() + 4;
+                packet.size = captured;
+                packet.originalSize = original;
+                return true;
+            }
+        }
+    }
+
+    FILE* m_input;
+    bool m_pcapng;
+    bool m_swapped;
+    uint32_t m_linkType;
+    uint64_t m_unitsPerSecond;
+    bool m_malformed;
+    std::vector<Interface> m_interfaces;
+    std::vector<uint8_t> m_record;
+};
+
+// Writes a pcapng file, low byte first, with nanosecond timestamps. Each
+// packet goes out as an enhanced packet block as soon as it is written, with
+// an optional comment to annotate it.
+class PcapngWriter
+{
+public:
+    PcapngWriter(FILE* output)
+        :m_output(output),
+        m_interfaceCount(0)
+    {
+        // section header, byte order magic, version 1.0, unknown section length
+        BeginBlock(0x0A0D0D0A);
+        Put32(0x1A2B3C4D);
+        Put16(1);
+        Put16(0);
+        Put32(0xFFFFFFFF);
+        Put32(0xFFFFFFFF);
+        EndBlock();
+    }
+
+    // returns the interface id to write its packets with
+    uint32_t AddInterface(uint32_t linkType, uint32_t snapLength = 0)
+    {
+        BeginBlock(1);
+        Put16(static_cast<uint16_t>(linkType));
+        Put16(0);
+        Put32(snapLength);
+        // if_tsresol, nanoseconds
+        Put16(9);
+        Put16(1);
+        m_block.push_back(9);
+        Pad();
+        PutEndOfOptions();
+        EndBlock();
+        return m_interfaceCount++;
+    }
+
+    void WritePacket(uint32_t interfaceId, uint64_t timestampNs, const uint8_t* data, size_t size, size_t originalSize, const std::string& comment = std::string())
+    {
+        BeginBlock(6);
+        Put32(interfaceId);
+        Put32(static_cast<uint32_t>(timestampNs >> 32));
+        Put32(static_cast<uint32_t>(timestampNs & 0xFFFFFFFF));
+        Put32(static_cast<uint32_t>(size));
+        Put32(static_cast<uint32_t>(originalSize));
+        m_block.insert(m_block.end(), data, data + size);
+        Pad();
+        if (comment.empty() == false)
+        {
+            // opt_comment
+            const size_t commentSize = comment.size() < 0xFFFF ? comment.size() : 0xFFFF;
+            Put16(1);
+            Put16(static_cast<uint16_t>(commentSize));
+            m_block.insert(m_block.end(), comment.begin(), comment.begin() + commentSize);
+            Pad();
+            PutEndOfOptions();
+        }
+        EndBlock();
+    }
+
+    void Flush()
+    {
+        fflush(m_output);
+    }
+
+private:
+    void Put16(uint16_t value)
+    {
+        m_block.push_back(static_cast<uint8_t>(value & 0xFF));
+        m_block.push_back(static_cast<uint8_t>(value >> 8));
+    }
+
+    void Put32(uint32_t value)
+    {
+        Put16(static_cast<uint16_t>(value & 0xFFFF));
+        Put16(static_cast<uint16_t>(value >> 16));
+    }
+
+    void Pad()
+    {
+        while (m_block.size() & 3)
+        {
+            m_block.push_back(0);
+        }
+    }
+
+    void PutEndOfOptions()
+    {
+        Put32(0);
+    }
+
+    void BeginBlock(uint32_t type)
+    {
+        m_block.clear();
+        Put32(type);
+        // total length, filled in by EndBlock
+        Put32(0);
+    }
+
+    void EndBlock()
+    {
+        const uint32_t length = static_cast<uint32_t>(m_block.size() + 4);
+        Put32(length);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            m_block[4 + i] = static_cast<uint8_t>((length >> (8 * i)) & 0xFF);
+        }
+        fwrite(m_block.data(), 1, m_block.size(), m_output);
+    }
+
+    FILE* m_output;
+    uint32_t m_interfaceCount;
+    std::vector<uint8_t> m_block;
+};
@@ -0,0 +1,123 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Process wide tables for the hop selection kernel. PERM5 is 14 butterflies,
+// each swapping two bits of the 5 bit input when its control bit is set.
+// Controls P0 - P8 are D0 - D8 and P9 - P13 are C0 - C4 xor Y1. The butterflies
+// run in 7 stages from P13/P12 down to P1/P0, so the first 3 stages only see
+// the 6 controls P8 - P13 and the last 4 only P0 - P7. One table per half
+// holds the whole permutation for every control value, 2 KB and 8 KB, and
+// PERM5 is two lookups.
+//
+// The adder output is at most 31 + 127 + 127 + 63 with E and F taken as 7 bit
+// and Y2 as 6 bit values, so the mod 79 and the remap to the 0 - 78 channel
+// order are folded into one table indexed by the sum.
+class SelectionKernelTables
+{
+public:
+    static const uint32_t CHANNEL_COUNT = 79;
+    static const uint32_t MAX_SUM = 31 + 127 + 127 + 63;
+
+    static const SelectionKernelTables& Get()
+    {
+        static const SelectionKernelTables tables;
+        return tables;
+    }
+
+    // P8 - P13 as the index of the first half
+    static uint32_t HighControls(uint8_t C, uint16_t D, uint8_t Y1)
+    {
+        return ((D >> 8) & 1) | ((C ^ (Y1 ? 0x1F : 0)) & 0x1F) << 1;
+    }
+
+    uint8_t Perm(uint8_t z, uint8_t C, uint16_t D, uint8_t Y1) const
+    {
+        return m_low[D & 0xFF][m_high[HighControls(C, D, Y1)][z & 0x1F]];
+    }
+
+    // PERM5 of every input for one (C, D, Y1), for callers that keep C and D
+    void BuildPermutation(uint8_t C, uint16_t D, uint8_t Y1, uint8_t* perm) const
+    {
+        const uint8_t* high = m_high[HighControls(C, D, Y1)];
+        const uint8_t* low = m_low[D & 0xFF];
+        for (uint32_t z = 0; z < 32; z++)
+        {
+            perm[z] = low[high[z]];
+        }
+    }
+
+    // channel of an adder output, (sum % 79) to the 0 - 78 channel order
+    uint8_t Channel(uint32_t sum) const
+    {
+        return m_channel[sum];
+    }
+
+    // the 0 - 78 channel order alone
+    uint8_t Remap(uint32_t index) const
+    {
+        return m_channel[index % CHANNEL_COUNT];
+    }
+
+private:
+    SelectionKernelTables()
+    {
+        for (uint32_t controls = 0; controls < 64; controls++)
+        {
+            for (uint32_t z = 0; z < 32; z++)
+            {
+                m_high[controls][z] = Butterflies(static_cast<uint8_t>(z), controls << 8, 13, 8);
+            }
+        }
+        for (uint32_t controls = 0; controls < 256; controls++)
+        {
+            for (uint32_t z = 0; z < 32; z++)
+            {
+                m_low[controls][z] = Butterflies(static_cast<uint8_t>(z), controls, 7, 0);
+            }
+        }
+        for (uint32_t sum = 0; sum <= MAX_SUM; sum++)
+        {
+            uint32_t index = sum % CHANNEL_COUNT;
+            m_channel[sum] = static_cast<uint8_t>(index < 40 ? index * 2 : (index - 40) * 2 + 1);
+        }
+    }
+
+    // butterflies first down to last of the 14 controls, bit n being Pn
+    static uint8_t Butterflies(uint8_t z, uint32_t controls, uint32_t first, uint32_t last)
+    {
+        // the two z bits butterfly Pn exchanges
+        static const uint8_t pairs[14][2] =
+        {
+            { 0, 1 }, { 2, 3 }, { 1, 2 }, { 3, 4 }, { 0, 4 }, { 1, 3 }, { 0, 2 },
+            { 3, 4 }, { 1, 4 }, { 0, 3 }, { 2, 4 }, { 1, 3 }, { 0, 3 }, { 1, 2 },
+        };
+        for (uint32_t p = first + 1; p-- > last;)
+        {
+            if ((controls >> p) & 1)
+            {
+                uint8_t a = (z >> pairs[p][0]) & 1;
+                uint8_t b = (z >> pairs[p][1]) & 1;
+                if (a != b)
+                {
+                    z ^= static_cast<uint8_t>(1 << pairs[p][0] | 1 << pairs[p][1]);
+                }
+            }
+        }
+        return z;
+    }
+
+    uint8_t m_high[64][32];
+    uint8_t m_low[256][32];
+    uint8_t m_channel[MAX_SUM + 1];
+};
+
+// The hop selection kernel through the tables. Same result as the bit level
+// SelectionKernelReference for inputs in their field widths: X, A, C 5 bits,
+// B 4 bits, D 9 bits, E, F 7 bits, Y1 1 bit and Y2 0 or 32.
+inline uint8_t SelectionKernel(uint8_t X, uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint8_t E, uint8_t F, uint8_t Y1, uint8_t Y2)
+{
+    const SelectionKernelTables& tables = SelectionKernelTables::Get();
+    const uint8_t z = static_cast<uint8_t>(((X + A) & 0x1F) ^ (B & 0xF));
+    return tables.Channel(tables.Perm(z, C, D, Y1) + (E & 0x7F) + (F & 0x7F) + (Y2 & 0x3F));
+}
@@ -0,0 +1,260 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "SelectionKernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SELECTION_KERNEL_SIMD 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// The AVX2 path is compiled for AVX2 on its own and only called when the CPU
+// has it, so the rest of the program keeps the baseline instruction set
+#if defined(SELECTION_KERNEL_SIMD) && defined(__GNUC__)
+#define SELECTION_KERNEL_AVX2 __attribute__((target("avx2")))
+#else
+#define SELECTION_KERNEL_AVX2
+#endif
+
+// Kernel inputs of many candidates, one array per input, element i of each
+// being candidate i. Values are taken as SelectionKernel takes them.
+struct SelectionKernelInputs
+{
+    const uint8_t* X;
+    const uint8_t* A;
+    const uint8_t* B;
+    const uint8_t* C;
+    const uint16_t* D;
+    const uint8_t* E;
+    const uint8_t* F;
+    const uint8_t* Y1;
+    const uint8_t* Y2;
+};
+
+enum class SimdLevel
+{
+    Scalar,
+    Sse2,       // 16 candidates at a time
+    Avx2,       // 32 candidates at a time
+};
+
+// The table kernel gathers per candidate, which vectors can not do cheaply,
+// so the vector paths are bit sliced instead. Each of the 5 z bits and 14
+// controls is a vector with 0 or 1 per candidate, and butterfly Pn is
+// d = (za ^ zb) & Pn, za ^= d, zb ^= d on all candidates at once. The adder
+// stays in bytes by reducing mod 79 after every addition, min(s, s - 79)
+// being s - 79 exactly when s >= 79, and the remap is 2 x index reduced once.
+class SelectionKernelSimd
+{
+public:
+    static SimdLevel Detect()
+    {
+#if defined(SELECTION_KERNEL_SIMD)
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] >= 7)
+        {
+            __cpuid(info, 1);
+            bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+            __cpuidex(info, 7, 0);
+            if (osSavesYmm && (info[1] & (1 << 5)) != 0)
+            {
+                return SimdLevel::Avx2;
+            }
+        }
+#else
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return SimdLevel::Avx2;
+        }
+#endif
+        return SimdLevel::Sse2;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    // the best level of this CPU, detected once
+    static SimdLevel Best()
+    {
+        static const SimdLevel level = Detect();
+        return level;
+    }
+
+    // channels[i] = SelectionKernel of candidate i, for count candidates
+    static void Run(const SelectionKernelInputs& inputs, uint8_t* channels, size_t count, SimdLevel level = Best())
+    {
+        size_t done = 0;
+#if defined(SELECTION_KERNEL_SIMD)
+        if (level == SimdLevel::Avx2)
+        {
+            done = RunAvx2(inputs, channels, count);
+        }
+        else if (level == SimdLevel::Sse2)
+        {
+            done = RunSse2(inputs, channels, count);
+        }
+#else
+        (void)level;
+#endif
+        for (size_t i = done; i < count; i++)
+        {
+            channels[i] = SelectionKernel(inputs.X[i], inputs.A[i], inputs.B[i], inputs.C[i], inputs.D[i], inputs.E[i], inputs.F[i], inputs.Y1[i], inputs.Y2[i]);
+        }
+    }
+
+    static const char* Name(SimdLevel level)
+    {
+        return level == SimdLevel::Avx2 ? "avx2" : level == SimdLevel::Sse2 ? "sse2" : "scalar";
+    }
+
+private:
+#if defined(SELECTION_KERNEL_SIMD)
+    // butterfly on every candidate whose control is 1, a and b being z bits
+    static void Butterfly(__m128i& a, __m128i& b, __m128i control)
+    {
+        __m128i d = _mm_and_si128(_mm_xor_si128(a, b), control);
+        a = _mm_xor_si128(a, d);
+        b = _mm_xor_si128(b, d);
+    }
+
+    SELECTION_KERNEL_AVX2 static void ButterflyAvx2(__m256i& a, __m256i& b, __m256i control)
+    {
+        __m256i d = _mm256_and_si256(_mm256_xor_si256(a, b), control);
+        a = _mm256_xor_si256(a, d);
+        b = _mm256_xor_si256(b, d);
+    }
+
+    // whole blocks of 16, returns how many candidates were done
+    static size_t RunSse2(const SelectionKernelInputs& in, uint8_t* channels, size_t count)
+    {
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i one16 = _mm_set1_epi16(1);
+        const __m128i lowByte16 = _mm_set1_epi16(0xFF);
+        const __m128i channelCount = _mm_set1_epi8(static_cast<char>(SelectionKernelTables::CHANNEL_COUNT));
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i X = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.X + i));
+            __m128i A = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.A + i));
+            __m128i B = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.B + i));
+            __m128i C = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.C + i));
+            __m128i D0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.D + i));
+            __m128i D1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.D + i + 8));
+            __m128i Y1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.Y1 + i));
+
+            __m128i z = _mm_xor_si128(_mm_and_si128(_mm_add_epi8(X, A), _mm_set1_epi8(0x1F)), _mm_and_si128(B, _mm_set1_epi8(0xF)));
+            __m128i DLow = _mm_packus_epi16(_mm_and_si128(D0, lowByte16), _mm_and_si128(D1, lowByte16));
+            __m128i D8 = _mm_packus_epi16(_mm_and_si128(_mm_srli_epi16(D0, 8), one16), _mm_and_si128(_mm_srli_epi16(D1, 8), one16));
+            __m128i y = _mm_andnot_si128(_mm_cmpeq_epi8(Y1, _mm_setzero_si128()), one);
+
+            // bits are 0 or 1 per byte, so 16 bit shifts never cross bytes once masked
+            __m128i z0 = _mm_and_si128(z, one);
+            __m128i z1 = _mm_and_si128(_mm_srli_epi16(z, 1), one);
+            __m128i z2 = _mm_and_si128(_mm_srli_epi16(z, 2), one);
+            __m128i z3 = _mm_and_si128(_mm_srli_epi16(z, 3), one);
+            __m128i z4 = _mm_and_si128(_mm_srli_epi16(z, 4), one);
+            // P13 - P9 are C4 - C0 xor Y1, P8 is D8 and P7 - P0 are D7 - D0
+            Butterfly(z1, z2, _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(C, 4), one), y));
+            Butterfly(z0, z3, _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(C, 3), one), y));
+            Butterfly(z1, z3, _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(C, 2), one), y));
+            Butterfly(z2, z4, _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(C, 1), one), y));
+            Butterfly(z0, z3, _mm_xor_si128(_mm_and_si128(C, one), y));
+            Butterfly(z1, z4, D8);
+            Butterfly(z3, z4, _mm_and_si128(_mm_srli_epi16(DLow, 7), one));
+            Butterfly(z0, z2, _mm_and_si128(_mm_srli_epi16(DLow, 6), one));
+            Butterfly(z1, z3, _mm_and_si128(_mm_srli_epi16(DLow, 5), one));
+            Butterfly(z0, z4, _mm_and_si128(_mm_srli_epi16(DLow, 4), one));
+            Butterfly(z3, z4, _mm_and_si128(_mm_srli_epi16(DLow, 3), one));
+            Butterfly(z1, z2, _mm_and_si128(_mm_srli_epi16(DLow, 2), one));
+            Butterfly(z2, z3, _mm_and_si128(_mm_srli_epi16(DLow, 1), one));
+            Butterfly(z0, z1, _mm_and_si128(DLow, one));
+            __m128i perm = _mm_or_si128(_mm_or_si128(z0, _mm_slli_epi16(z1, 1)), _mm_or_si128(_mm_slli_epi16(z2, 2), _mm_or_si128(_mm_slli_epi16(z3, 3), _mm_slli_epi16(z4, 4))));
+
+            __m128i E = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in.E + i)), _mm_set1_epi8(0x7F));
+            __m128i F = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in.F + i)), _mm_set1_epi8(0x7F));
+            __m128i Y2 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in.Y2 + i)), _mm_set1_epi8(0x3F));
+            // PERM5 + E <= 158 reduces to <= 79, + F <= 206 and + Y2 <= 141 below 79
+            __m128i sum = _mm_add_epi8(perm, E);
+            sum = _mm_min_epu8(sum, _mm_sub_epi8(sum, channelCount));
+            sum = _mm_add_epi8(sum, F);
+            sum = _mm_min_epu8(sum, _mm_sub_epi8(sum, channelCount));
+            sum = _mm_min_epu8(sum, _mm_sub_epi8(sum, channelCount));
+            sum = _mm_add_epi8(sum, Y2);
+            sum = _mm_min_epu8(sum, _mm_sub_epi8(sum, channelCount));
+            // index < 40 is channel 2 x index, the rest 2 x index - 79
+            sum = _mm_add_epi8(sum, sum);
+            sum = _mm_min_epu8(sum, _mm_sub_epi8(sum, channelCount));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channels + i), sum);
+        }
+        return i;
+    }
+
+    // RunSse2 on 32 candidates at a time
+    SELECTION_KERNEL_AVX2 static size_t RunAvx2(const SelectionKernelInputs& in, uint8_t* channels, size_t count)
+    {
+        const __m256i one = _mm256_set1_epi8(1);
+        const __m256i one16 = _mm256_set1_epi16(1);
+        const __m256i lowByte16 = _mm256_set1_epi16(0xFF);
+        const __m256i channelCount = _mm256_set1_epi8(static_cast<char>(SelectionKernelTables::CHANNEL_COUNT));
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i X = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.X + i));
+            __m256i A = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.A + i));
+            __m256i B = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.B + i));
+            __m256i C = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.C + i));
+            __m256i D0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.D + i));
+            __m256i D1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.D + i + 16));
+            __m256i Y1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.Y1 + i));
+
+            __m256i z = _mm256_xor_si256(_mm256_and_si256(_mm256_add_epi8(X, A), _mm256_set1_epi8(0x1F)), _mm256_and_si256(B, _mm256_set1_epi8(0xF)));
+            // packus works within 128 bit halves, the permute puts D back in candidate order
+            __m256i DLow = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(D0, lowByte16), _mm256_and_si256(D1, lowByte16)), 0xD8);
+            __m256i D8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(_mm256_srli_epi16(D0, 8), one16), _mm256_and_si256(_mm256_srli_epi16(D1, 8), one16)), 0xD8);
+            __m256i y = _mm256_andnot_si256(_mm256_cmpeq_epi8(Y1, _mm256_setzero_si256()), one);
+
+            __m256i z0 = _mm256_and_si256(z, one);
+            __m256i z1 = _mm256_and_si256(_mm256_srli_epi16(z, 1), one);
+            __m256i z2 = _mm256_and_si256(_mm256_srli_epi16(z, 2), one);
+            __m256i z3 = _mm256_and_si256(_mm256_srli_epi16(z, 3), one);
+            __m256i z4 = _mm256_and_si256(_mm256_srli_epi16(z, 4), one);
+            // P13 - P9 are C4 - C0 xor Y1, P8 is D8 and P7 - P0 are D7 - D0
+            ButterflyAvx2(z1, z2, _mm256_xor_si256(_mm256_and_si256(_mm256_srli_epi16(C, 4), one), y));
+            ButterflyAvx2(z0, z3, _mm256_xor_si256(_mm256_and_si256(_mm256_srli_epi16(C, 3), one), y));
+            ButterflyAvx2(z1, z3, _mm256_xor_si256(_mm256_and_si256(_mm256_srli_epi16(C, 2), one), y));
+            ButterflyAvx2(z2, z4, _mm256_xor_si256(_mm256_and_si256(_mm256_srli_epi16(C, 1), one), y));
+            ButterflyAvx2(z0, z3, _mm256_xor_si256(_mm256_and_si256(C, one), y));
+            ButterflyAvx2(z1, z4, D8);
+            ButterflyAvx2(z3, z4, _mm256_and_si256(_mm256_srli_epi16(DLow, 7), one));
+            ButterflyAvx2(z0, z2, _mm256_and_si256(_mm256_srli_epi16(DLow, 6), one));
+            ButterflyAvx2(z1, z3, _mm256_and_si256(_mm256_srli_epi16(DLow, 5), one));
+            ButterflyAvx2(z0, z4, _mm256_and_si256(_mm256_srli_epi16(DLow, 4), one));
+            ButterflyAvx2(z3, z4, _mm256_and_si256(_mm256_srli_epi16(DLow, 3), one));
+            ButterflyAvx2(z1, z2, _mm256_and_si256(_mm256_srli_epi16(DLow, 2), one));
+            ButterflyAvx2(z2, z3, _mm256_and_si256(_mm256_srli_epi16(DLow, 1), one));
+            ButterflyAvx2(z0, z1, _mm256_and_si256(DLow, one));
+            __m256i perm = _mm256_or_si256(_mm256_or_si256(z0, _mm256_slli_epi16(z1, 1)), _mm256_or_si256(_mm256_slli_epi16(z2, 2), _mm256_or_si256(_mm256_slli_epi16(z3, 3), _mm256_slli_epi16(z4, 4))));
+
+            __m256i E = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.E + i)), _mm256_set1_epi8(0x7F));
+            __m256i F = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.F + i)), _mm256_set1_epi8(0x7F));
+            __m256i Y2 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.Y2 + i)), _mm256_set1_epi8(0x3F));
+            __m256i sum = _mm256_add_epi8(perm, E);
+            sum = _mm256_min_epu8(sum, _mm256_sub_epi8(sum, channelCount));
+            sum = _mm256_add_epi8(sum, F);
+            sum = _mm256_min_epu8(sum, _mm256_sub_epi8(sum, channelCount));
+            sum = _mm256_min_epu8(sum, _mm256_sub_epi8(sum, channelCount));
+            sum = _mm256_add_epi8(sum, Y2);
+            sum = _mm256_min_epu8(sum, _mm256_sub_epi8(sum, channelCount));
+            sum = _mm256_add_epi8(sum, sum);
+            sum = _mm256_min_epu8(sum, _mm256_sub_epi8(sum, channelCount));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(channels + i), sum);
+        }
+        return i;
+    }
+#endif
+};
@@ -0,0 +1,225 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "BatchProcessor.h"
+#include "OutputWriter.h"
+
+// Reads capture records, as BatchRecord describes them, from a stream such as
+// stdin with bounded memory. A reader thread fills one of two fixed buffers
+// while records are processed straight out of the other, so reading overlaps
+// processing. A record split across buffers is assembled in a fixed carry
+// buffer sized for the largest record, so memory never grows with the input.
+// Each buffer is handed over with whatever one read of the descriptor gave,
+// so a slow live source such as a demodulator in a pipe is processed as it
+// arrives rather than once a whole buffer has built up.
+class RecordStream
+{
+public:
+    static const size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+    static const size_t MAX_RECORD_SIZE = BATCH_RECORD_HEADER_SIZE + 0xFFFF;
+
+    RecordStream(FILE* input, size_t bufferSize = DEFAULT_BUFFER_SIZE)
+        :m_input(input),
+        m_bufferSize(bufferSize != 0 ? bufferSize : DEFAULT_BUFFER_SIZE),
+        m_carry(MAX_RECORD_SIZE)
+    {
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            m_buffers[i].data.resize(m_bufferSize);
+            m_buffers[i].size = 0;
+            m_buffers[i].full = false;
+            m_buffers[i].last = false;
+        }
+    }
+
+    // process(record) for every record in the stream. Returns false when the
+    // stream ended inside a record.
+    template <typename Process>
+    bool Run(Process process)
+    {
+        return Run(process, []() {});
+    }
+
+    // Run, calling idle() each time processing is about to wait for input,
+    // where a caller flushes its output so a live stream sees every result
+    template <typename Process, typename Idle>
+    bool Run(Process process, Idle idle)
+    {
+        std::thread reader(&RecordStream::ReadLoop, this);
+        size_t carrySize = 0;
+        bool last = false;
+        for (uint32_t bufferIndex = 0; last == false; bufferIndex ^= 1)
+        {
+            Buffer& buffer = m_buffers[bufferIndex];
+            bool waiting;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                waiting = buffer.full == false;
+            }
+            if (waiting)
+            {
+                idle();
+            }
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [&buffer]() { return buffer.full; });
+            }
+            last = buffer.last;
+            const uint8_t* data = buffer.data.data();
+            size_t size = buffer.size;
+            size_t offset = 0;
+
+            while (offset < size)
+            {
+                size_t available = size - offset;
+                if (carrySize == 0 && available >= BATCH_RECORD_HEADER_SIZE)
+                {
+                    size_t recordSize = BATCH_RECORD_HEADER_SIZE + RecordLength(data + offset);
+                    if (available >= recordSize)
+                    {
+                        process(MakeRecord(data + offset));
+                        offset += recordSize;
+                        continue;
+                    }
+                }
+
+                // the record runs past this buffer, gather it in the carry buffer
+                size_t wanted = carrySize < BATCH_RECORD_HEADER_SIZE ? BATCH_RECORD_HEADER_SIZE : BATCH_RECORD_HEADER_SIZE + RecordLength(m_carry.data());
+                size_t take = wanted - carrySize < available ? wanted - carrySize : available;
+                memcpy(&m_carry[carrySize], data + offset, take);
+                carrySize += take;
+                offset += take;
+                if (carrySize >= BATCH_RECORD_HEADER_SIZE && carrySize == BATCH_RECORD_HEADER_SIZE + RecordLength(m_carry.data()))
+                {
+                    process(MakeRecord(m_carry.data()));
+                    carrySize = 0;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                buffer.full = false;
+            }
+            m_changed.notify_all();
+        }
+        reader.join();
+        return carrySize == 0;
+    }
+
+private:
+    struct Buffer
+    {
+        std::vector<uint8_t> data;
+        size_t size;
+        bool full;
+        // nothing follows this buffer
+        bool last;
+    };
+
+    static size_t RecordLength(const uint8_t* record)
+    {
+        return record[4] | record[5] << 8;
+    }
+
+    static BatchRecord MakeRecord(const uint8_t* record)
+    {
+        BatchRecord batchRecord;
+        batchRecord.clock = record[0] | record[1] << 8 | record[2] << 16 | static_cast<uint32_t>(record[3]) << 24;
+        batchRecord.size = RecordLength(record);
+        batchRecord.data = record + BATCH_RECORD_HEADER_SIZE;
+        return batchRecord;
+    }
+
+    // one read of the descriptor under m_input, stdio would wait for all of size
+    size_t ReadSome(uint8_t* data, size_t size)
+    {
+        for (;;)
+        {
+#ifdef _WIN32
+            int bytesRead = _read(_fileno(m_input), data, static_cast<unsigned int>(size < 0x40000000 ? size : 0x40000000));
+#else
+            ssize_t bytesRead = read(fileno(m_input), data, size);
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+#endif
+            return bytesRead > 0 ? static_cast<size_t>(bytesRead) : 0;
+        }
+    }
+
+    void ReadLoop()
+    {
+        bool last = false;
+        for (uint32_t bufferIndex = 0; last == false; bufferIndex ^= 1)
+        {
+            Buffer& buffer = m_buffers[bufferIndex];
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [&buffer]() { return buffer.full == false; });
+            }
+            // a short read is handed over as it is, end of input or an error ends the stream
+            size_t size = ReadSome(buffer.data.data(), m_bufferSize);
+            last = size == 0;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                buffer.size = size;
+                buffer.last = last;
+                buffer.full = true;
+            }
+            m_changed.notify_all();
+        }
+    }
+
+    FILE* m_input;
+    size_t m_bufferSize;
+    Buffer m_buffers[2];
+    std::vector<uint8_t> m_carry;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+};
+
+// Writes records to a stream through OutputWriter, either raw in the capture
+// format or as one line of hex per record, which HexParser reads back.
+class RecordWriter
+{
+public:
+    RecordWriter(FILE* output, bool hexText, size_t bufferSize = RecordStream::DEFAULT_BUFFER_SIZE)
+        :m_writer(output, bufferSize),
+        m_hexText(hexText)
+    {
+    }
+
+    // one whole record, header included
+    void Write(const uint8_t* record, size_t size)
+    {
+        if (m_hexText == false)
+        {
+            m_writer.Write(record, size);
+            return;
+        }
+        m_writer.HexBytes(record, size);
+        m_writer.Char('\n');
+    }
+
+    void Flush()
+    {
+        m_writer.Flush();
+    }
+
+private:
+    OutputWriter m_writer;
+    bool m_hexText;
+};
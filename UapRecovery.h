@@ -0,0 +1,134 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "BluetoothWhitening.h"
+#include "BluetoothHec.h"
+#include "BluetoothCrc.h"
+
+// Recovers the UAP of a piconet with a known LAP from captured packets.
+// Every packet scores all 256 UAP candidates at once: one point for a HEC match
+// and, when the payload is given, one point for a CRC match. Both checks are
+// linear in the UAP, so each packet costs one table pass over the candidates
+// instead of 256 LFSR runs, and the answer firms up as packets arrive.
+//
+// Headers are 3 whitened bytes in the WhitenData layout, header bits 0 - 9 then
+// the HEC in bits 10 - 17. Payloads are the whitened, FEC decoded bytes that
+// follow, ending in the CRC, low byte first.
+class UapRecovery
+{
+public:
+    static const uint32_t UAP_COUNT = 256;
+    // lead the best candidate needs over the runner up before it is reported
+    static const uint32_t CONVERGE_MARGIN = 2;
+
+    UapRecovery()
+        :hecTable(BluetoothHecTable::Get()),
+        crc16(BluetoothCrc16::Get())
+    {
+        for (uint32_t uap = 0; uap < UAP_COUNT; uap++)
+        {
+            hecUapPart[uap] = hecTable.UapPart(static_cast<uint8_t>(uap));
+        }
+        Reset();
+    }
+
+    void Reset()
+    {
+        for (uint32_t uap = 0; uap < UAP_COUNT; uap++)
+        {
+            scores[uap] = 0;
+        }
+        packetCount = 0;
+    }
+
+    void AddPacket(uint32_t clock, const uint8_t* header, const uint8_t* payload = nullptr, size_t payloadSize = 0)
+    {
+        BluetoothWhitening whitening(clock);
+        uint8_t headerBytes[3];
+        whitening.WhitenData(header, sizeof(headerBytes), headerBytes, sizeof(headerBytes));
+        uint32_t headerBits = headerBytes[0] | headerBytes[1] << 8 | headerBytes[2] << 16;
+
+        // HEC(uap, header) = uap part ^ header part, so the HEC matches where
+        // the uap part equals the received HEC ^ header part
+        uint8_t hecTarget = static_cast<uint8_t>((headerBits >> 10) & 0xFF) ^ hecTable.HeaderPart(headerBits & BluetoothHecTable::HEADER_MASK);
+        for (uint32_t uap = 0; uap < UAP_COUNT; uap++)
+        {
+            scores[uap] += hecUapPart[uap] == hecTarget ? 1 : 0;
+        }
+
+        if (payload != nullptr && payloadSize > 2)
+        {
+            ScoreCrc(whitening, payload, payloadSize);
+        }
+        packetCount++;
+    }
+
+    // best candidate so far, true once it leads every other one by CONVERGE_MARGIN
+    bool GetUap(uint8_t& uap, uint32_t& score) const
+    {
+        uint32_t best = 0;
+        uint32_t runnerUp = 0;
+        uap = 0;
+        for (uint32_t candidate = 0; candidate < UAP_COUNT; candidate++)
+        {
+            if (scores[candidate] > best)
+            {
+                runnerUp = best;
+                best = scores[candidate];
+                uap = static_cast<uint8_t>(candidate);
+            }
+            else if (scores[candidate] > runnerUp)
+            {
+                runnerUp = scores[candidate];
+            }
+        }
+        score = best;
+        return best >= runnerUp + CONVERGE_MARGIN;
+    }
+
+    uint32_t GetScore(uint8_t uap) const { return scores[uap]; }
+    uint32_t GetPacketCount() const { return packetCount; }
+
+private:
+    // CRC(uap, body) = CRC(uap, zeros) ^ CRC(0, body) and CRC(uap, zeros) is
+    // linear in the uap, so 8 CRCs over zeros give every candidate's seed part.
+    void ScoreCrc(BluetoothWhitening& whitening, const uint8_t* payload, size_t payloadSize)
+    {
+        payloadBuffer.resize(payloadSize);
+        whitening.WhitenPayload(payload, payloadBuffer.data(), payloadSize);
+        const size_t bodySize = payloadSize - 2;
+        const uint16_t crcReceived = payloadBuffer[bodySize] | payloadBuffer[bodySize + 1] << 8;
+        const uint16_t crcTarget = crcReceived ^ crc16.Update(0, payloadBuffer.data(), bodySize);
+
+        zeroBuffer.resize(bodySize);
+        uint16_t seedParts[8];
+        for (uint32_t bit = 0; bit < 8; bit++)
+        {
+            seedParts[bit] = crc16.Calc(static_cast<uint8_t>(1 << bit), zeroBuffer.data(), bodySize);
+        }
+        crcSeedPart[0] = 0;
+        for (uint32_t uap = 1; uap < UAP_COUNT; uap++)
+        {
+            uint32_t lowBit = 0;
+            while (((uap >> lowBit) & 1) == 0)
+            {
+                lowBit++;
+            }
+            crcSeedPart[uap] = crcSeedPart[uap & (uap - 1)] ^ seedParts[lowBit];
+        }
+        for (uint32_t uap = 0; uap < UAP_COUNT; uap++)
+        {
+            scores[uap] += crcSeedPart[uap] == crcTarget ? 1 : 0;
+        }
+    }
+
+    const BluetoothHecTable& hecTable;
+    const BluetoothCrc16& crc16;
+    uint8_t hecUapPart[UAP_COUNT];
+    uint16_t crcSeedPart[UAP_COUNT];
+    uint32_t scores[UAP_COUNT];
+    uint32_t packetCount;
+    std::vector<uint8_t> payloadBuffer;
+    std::vector<uint8_t> zeroBuffer;
+};
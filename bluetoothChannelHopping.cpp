@@ -2,9 +2,14 @@
 #include <stdint.h>
 #include "BluetoothWhitening.h"
 #include "LinearFeedbackShiftRegister.h"
+#include "SelectionKernel.h"
+#include "SelectionKernelSimd.h"
+#include "HopSequence.h"
+#include "OutputWriter.h"
 
 #include <vector>
 #include <string>
+#include <chrono>
 
 #ifndef _WIN32
 int fopen_s(FILE** pFile, const char *filename, const char *mode)
@@ -23,14 +28,24 @@ int fopen_s(FILE** pFile, const char *filename, const char *mode)
 #define fscanf_s    fscanf
 #endif
 
-void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterations, uint32_t N = 0);
+void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterations, const ChannelMap& channelMap);
+uint32_t VerifySelectionKernel();
+uint32_t VerifyHopSequence();
+uint32_t VerifyBasicChannels();
+uint32_t VerifyAdaptedChannels();
+uint32_t VerifySelectionKernelSimd();
 
 void printhelp(const char* exeName)
 {
     printf("%s -m <mode> -a <address> -c <clk>\n", exeName);
     printf("mode: 0 - Page Scan Inquiry Scan\n");
+    printf("      1 - Page\n");
+    printf("      3 - Connection state basic channel, one line per slot for --i slots\n");
+    printf("      4 - Connection state adapted channel under --map, as mode 3\n");
+    printf("map: AFH channel map as 20 hex digits, channel 0 in the low bit of the first byte\n");
     printf("address: UAP and LAP hex\n");
     printf("clk: Estimated target clk.\n");
+    printf("--v: checks the table driven, bulk, adapted and SIMD kernels against the bit level one and times them\n");
     printf("Example: %s -m 0 -a 01020304 -c 00000000 \n", exeName);
     printf("Output: \n");
 //    printf("%s\n", exeName);
@@ -49,6 +64,8 @@ int unitTestIndex = -1;
 int unitTestPassed = 0;
 uint8_t koffset = 0;
 uint8_t knudge = 0;
+bool verifyMode = false;
+ChannelMap channelMap;
 
 static void parseArgs(std::vector<std::string> args)
 {
@@ -60,6 +77,7 @@ static void parseArgs(std::vector<std::string> args)
     clk = 0;
     temp = 0;
     testResults = false;
+    verifyMode = false;
 
     for (size_t i = 1; i < args.size(); i++)
     {
@@ -77,6 +95,8 @@ static void parseArgs(std::vector<std::string> args)
                     {
                     case 0:
                     case 1:
+                    case 3:
+                    case 4:
                         break;
                     default:
                         printf("Invalid mode %u\n", mode);
@@ -138,6 +158,35 @@ static void parseArgs(std::vector<std::string> args)
                 }
             }
         }
+        else if (args[i] == "--map")
+        {
+            i++;
+            if(i < args.size())
+            {
+                uint8_t map[ChannelMap::MAP_SIZE];
+                bool parsed = args[i].size() == 2 * ChannelMap::MAP_SIZE;
+                for (size_t byte = 0; parsed && byte < ChannelMap::MAP_SIZE; byte++)
+                {
+                    std::string digits = args[i].substr(2 * byte, 2);
+                    map[byte] = static_cast<uint8_t>(strtol(digits.c_str(), &endPtr, 16));
+                    parsed = endPtr == digits.c_str() + 2;
+                }
+                if (parsed == false)
+                {
+                    printf("Unable to parse channel map %s\n", args[i].c_str());
+                    exit(-1);
+                }
+                if (channelMap.Set(map) == false)
+                {
+                    printf("Channel map %s uses fewer than %u channels\n", args[i].c_str(), ChannelMap::MIN_USED);
+                    exit(-1);
+                }
+            }
+        }
+        else if (args[i] == "--v")
+        {
+            verifyMode = true;
+        }
         else if (args[i] == "--i")
         {
             i++;
@@ -166,6 +215,25 @@ int main(int argc, const char* argv[])
 
     parseArgs(args);
 
+    if (verifyMode)
+    {
+        uint32_t mismatches = VerifySelectionKernel();
+        printf("selection kernel mismatches %u\n", mismatches);
+        uint32_t sequenceMismatches = VerifyHopSequence();
+        printf("hop sequence mismatches %u\n", sequenceMismatches);
+        mismatches += sequenceMismatches;
+        uint32_t basicMismatches = VerifyBasicChannels();
+        printf("basic channel mismatches %u\n", basicMismatches);
+        mismatches += basicMismatches;
+        uint32_t adaptedMismatches = VerifyAdaptedChannels();
+        printf("adapted channel mismatches %u\n", adaptedMismatches);
+        mismatches += adaptedMismatches;
+        uint32_t simdMismatches = VerifySelectionKernelSimd();
+        printf("simd kernel mismatches %u\n", simdMismatches);
+        mismatches += simdMismatches;
+        return mismatches == 0 ? 0 : 1;
+    }
+
 //    if (unitTestIndex >= 0)
 //    {
 //        iterations = unitTests.size();
@@ -202,7 +270,7 @@ int main(int argc, const char* argv[])
 //            printhelp(argv[0]);
 //            exit(-3);
 //        }
-        TestHop(mode, address, clk, iterations);
+        TestHop(mode, address, clk, iterations, channelMap);
 
 //        if (testResults)
 //        {
@@ -242,14 +310,14 @@ int main(int argc, const char* argv[])
 //    }
 }
 
-uint8_t SelectionKernel(uint8_t X, uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint8_t E, uint8_t F, uint8_t Y1, uint8_t Y2);
+uint8_t SelectionKernelReference(uint8_t X, uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint8_t E, uint8_t F, uint8_t Y1, uint8_t Y2);
 
 uint8_t GetBit(uint32_t source, uint8_t index, uint8_t outIndex)
 {
     uint8_t returnVal = (source >> index) & 1;
     return returnVal << outIndex;
 }
-void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterations, uint32_t N)
+void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterations, const ChannelMap& channelMap)
 {
     // Page, Page Response
     // A23_0 = LAP of device being paged
@@ -279,6 +347,7 @@ void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterati
     // F25 -> 10011 -> 0x13
     // 6EF -> 110111011 -> 0x1BB
     // EF25 -> 1110100 -> 0x74
+    const HopSequence sequence(address);
     if(mode == 0)
     {
         uint32_t endClock = clkStart + iterations * 0x1000;
@@ -288,20 +357,12 @@ void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterati
             uint32_t clk4_20 = ((clk >> 1) & 0x1E) | (clk & 1);
             uint32_t clk2 = 0;//(clk16_12 + koffset + knudge + (clk4_20 - clk16_12 + 32) & 0xF) & 0x1F;
             uint8_t X = ((clk >> 12) + clk2) & 0x1F ;
-            uint8_t A = (address >> 23) & 0x1F;
-            uint8_t B = (address >> 19) & 0xF;
-            uint8_t C = (GetBit(address, 8, 4) | GetBit(address, 6, 3) | GetBit(address, 4, 2) | GetBit(address, 2, 1) | GetBit(address, 0, 0))  & 0x1F;
-            uint16_t D = (address >> 10) & 0x1FF;
-            uint8_t E = (GetBit(address, 13, 6) | GetBit(address, 11, 5) | GetBit(address, 9, 4) | GetBit(address, 7, 3) | GetBit(address, 5, 2) | GetBit(address, 3, 1) | GetBit(address, 1, 0))  & 0x7F;
-            uint8_t F = 0;
-            uint8_t Y1 = 0;
-            uint8_t Y2 = 0;
-            uint8_t channel = SelectionKernel(X, A, B, C, D, E, F, Y1, Y2);
+            uint8_t channel = sequence.ScanChannel(X);
             printf("address %08X clk %08X channel %2u\n", address, clk, channel);
 
             if(clk + 0x1000 >= endClock)
             {
-                printf("X %08X A %08X B %08X C %08X D %08X E %08X F %08X ADDR %08X\n", X, A, B, C, D, E, F, address);
+                printf("X %08X A %08X B %08X C %08X D %08X E %08X F %08X ADDR %08X\n", X, sequence.A(), sequence.B(), sequence.C(), sequence.D(), sequence.E(), 0, address);
             }
         }
     }
@@ -332,15 +393,8 @@ void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterati
             uint32_t clk4_20 = ((clk >> 1) & 0x0E) | (clk & 1);
             uint32_t Xp = (clk16_12 + koffset + knudge + ((clk4_20 - clk16_12 + 32) & 0xF)) & 0x1F;
             uint8_t X = Xp;//((clk >> 12) + clk2) & 0x1F ;
-            uint8_t A = (address >> 23) & 0x1F;
-            uint8_t B = (address >> 19) & 0xF;
-            uint8_t C = (GetBit(address, 8, 4) | GetBit(address, 6, 3) | GetBit(address, 4, 2) | GetBit(address, 2, 1) | GetBit(address, 0, 0))  & 0x1F;
-            uint16_t D = (address >> 10) & 0x1FF;
-            uint8_t E = (GetBit(address, 13, 6) | GetBit(address, 11, 5) | GetBit(address, 9, 4) | GetBit(address, 7, 3) | GetBit(address, 5, 2) | GetBit(address, 3, 1) | GetBit(address, 1, 0))  & 0x7F;
-            uint8_t F = 0;
             uint8_t Y1 = (clk >> 1) & 1;
-            uint8_t Y2 = (Y1 * 32);
-            uint8_t channel = SelectionKernel(X, A, B, C, D, E, F, Y1, Y2);
+            uint8_t channel = sequence.TrainChannel(X, Y1);
             if((clk & 0x03) >= 2)
             {
                 printf("RXTick      address %08X clk %08X channel %2u\n", address, clk, channel);
@@ -353,7 +407,7 @@ void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterati
 
             if(clk + 1 >= endClock)
             {
-                printf("X %08X A %08X B %08X C %08X D %08X E %08X F %08X ADDR %08X\n", X, A, B, C, D, E, F, address);
+                printf("X %08X A %08X B %08X C %08X D %08X E %08X F %08X ADDR %08X\n", X, sequence.A(), sequence.B(), sequence.C(), sequence.D(), sequence.E(), 0, address);
             }
         }
     }
@@ -377,20 +431,12 @@ void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterati
             uint32_t clk4_20 = ((clk >> 1) & 0x1E) | (clk & 1);
             uint32_t Xp = (clk16_12 + koffset + knudge + (clk4_20 - clk16_12 + 32) & 0xF) & 0x1F;
             uint8_t X = Xp;//((clk >> 12) + clk2) & 0x1F ;
-            uint8_t A = (address >> 23) & 0x1F;
-            uint8_t B = (address >> 19) & 0xF;
-            uint8_t C = (GetBit(address, 8, 4) | GetBit(address, 6, 3) | GetBit(address, 4, 2) | GetBit(address, 2, 1) | GetBit(address, 0, 0))  & 0x1F;
-            uint16_t D = (address >> 10) & 0x1FF;
-            uint8_t E = (GetBit(address, 13, 6) | GetBit(address, 11, 5) | GetBit(address, 9, 4) | GetBit(address, 7, 3) | GetBit(address, 5, 2) | GetBit(address, 3, 1) | GetBit(address, 1, 0))  & 0x7F;
-            uint8_t F = 0;
-            uint8_t Y1 = 0;
-            uint8_t Y2 = 0;
-            uint8_t channel = SelectionKernel(X, A, B, C, D, E, F, Y1, Y2);
+            uint8_t channel = sequence.ScanChannel(X);
             printf("address %08X clk %08X channel %2u\n", address, clk, channel);
 
             if(clk + 0x1000 >= endClock)
             {
-                printf("X %08X A %08X B %08X C %08X D %08X E %08X F %08X ADDR %08X\n", X, A, B, C, D, E, F, address);
+                printf("X %08X A %08X B %08X C %08X D %08X E %08X F %08X ADDR %08X\n", X, sequence.A(), sequence.B(), sequence.C(), sequence.D(), sequence.E(), 0, address);
             }
         }
     }
@@ -405,41 +451,626 @@ void TestHop(uint8_t mode, uint32_t address, uint32_t clkStart, uint32_t iterati
     // E  = A13,11,9,7,5,3,1
     // F  = 16 x CLK27_7 % 79
     // F' = 16 x CLK27_7 % N
-    if(mode == 2)
+    // Adapted channel
+    // X = CLK6_2
+    // Y1 = 0
+    // Y2 = 0
+    // A - F as the connection state
+    // F' = 16 x CLK27_7 % N
+    if(mode == 3 || mode == 4)
     {
-        uint32_t endClock = clkStart + iterations * 0x1000;
-        for(uint32_t clk = clkStart; clk < endClock; clk += 0x1000)
+        // iterations slots from clkStart, generated a block at a time
+        OutputWriter out(stdout);
+        uint8_t channels[4096];
+        uint32_t clk = clkStart & ~1u;
+        for (uint32_t done = 0; done < iterations;)
         {
-            uint32_t clk16_12 = (clk >> 12) & 0x1F;
-            uint32_t clk4_20 = ((clk >> 1) & 0x1E) | (clk & 1);
-            uint32_t Xp = (clk16_12 + koffset + knudge + (clk4_20 - clk16_12 + 32) & 0xF) & 0x1F;
-            uint8_t X = ((clk >> 2)) & 0x1F ;
-            uint8_t A = ((address >> 23) & 0x1F) ^ ((clk >> 21)&0x1F);
-            uint8_t B = (address >> 19) & 0xF;
-            uint8_t C = (GetBit(address, 8, 4) | GetBit(address, 6, 3) | GetBit(address, 4, 2) | GetBit(address, 2, 1) | GetBit(address, 0, 0))  & 0x1F;
-            C ^= ((clk >> 16) & 0x1F);
-            uint16_t D = (address >> 10) & 0x1FF;
-            D ^= ((clk >> 7) & 0x1F);
-            uint8_t E = (GetBit(address, 13, 6) | GetBit(address, 11, 5) | GetBit(address, 9, 4) | GetBit(address, 7, 3) | GetBit(address, 5, 2) | GetBit(address, 3, 1) | GetBit(address, 1, 0))  & 0x7F;
-            uint8_t F = (16 * ((clk>>7)&0x1FFFFF)) % 79;
-            uint8_t Fprime = (16 * ((clk>>7)&0x1FFFFF)) % N; // what is N
-            uint8_t Y1 = clk & 1;
-            uint8_t Y2 = 32 * Y1;// this cant be right
-            uint8_t channel = SelectionKernel(X, A, B, C, D, E, F, Y1, Y2);
-            printf("address %08X clk %08X channel %2u\n", address, clk, channel);
+            uint32_t count = iterations - done < sizeof(channels) ? iterations - done : sizeof(channels);
+            if (mode == 3)
+            {
+                sequence.BasicChannels(clk, channels, count);
+            }
+            else
+            {
+                sequence.AdaptedChannels(clk, channelMap, channels, count);
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                out.Text("address ");
+                out.Hex(address, 8);
+                out.Text(" clk ");
+                out.Hex((clk + 2 * i) & HopSequence::CLOCK_MASK, 8);
+                out.Text(" channel ");
+                out.Char(channels[i] < 10 ? ' ' : static_cast<char>('0' + channels[i] / 10));
+                out.Char(static_cast<char>('0' + channels[i] % 10));
+                out.Char('\n');
+            }
+            done += count;
+            clk = (clk + 2 * count) & HopSequence::CLOCK_MASK;
+        }
+    }
 
-            if(clk + 0x1000 >= endClock)
+}
+
+
+// The kernel is PERM5 of ((X + A) % 32) ^ B under (C, D, Y1), then the adder
+// and remap of that with E, F and Y2. Each stage is checked over its whole
+// input space against the bit level kernel: every z, C, D and Y1 with the
+// adder inputs at 0, every X, A and B for a spread of C and D, and every E, F
+// and Y2 on top of every PERM5 output.
+uint32_t VerifySelectionKernel()
+{
+    uint32_t mismatches = 0;
+    uint64_t calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t Y1 = 0; Y1 < 2; Y1++)
+    {
+        for (uint32_t D = 0; D < 512; D++)
+        {
+            for (uint32_t C = 0; C < 32; C++)
+            {
+                for (uint32_t X = 0; X < 32; X++)
+                {
+                    uint8_t expected = SelectionKernelReference(X, 0, 0, C, D, 0, 0, Y1, 0);
+                    mismatches += SelectionKernel(X, 0, 0, C, D, 0, 0, Y1, 0) != expected ? 1 : 0;
+                    calls++;
+                }
+            }
+        }
+    }
+    for (uint32_t CD = 0; CD < 512 * 32; CD += 97)
+    {
+        uint8_t C = CD & 0x1F;
+        uint16_t D = (CD >> 5) & 0x1FF;
+        for (uint32_t XAB = 0; XAB < (1 << 14); XAB++)
+        {
+            uint8_t X = XAB & 0x1F;
+            uint8_t A = (XAB >> 5) & 0x1F;
+            uint8_t B = (XAB >> 10) & 0xF;
+            uint8_t Y1 = CD & 1;
+            uint8_t expected = SelectionKernelReference(X, A, B, C, D, 0, 0, Y1, 0);
+            mismatches += SelectionKernel(X, A, B, C, D, 0, 0, Y1, 0) != expected ? 1 : 0;
+            calls++;
+        }
+    }
+    // PERM5 under C = D = Y1 = 0 is the identity, so X alone picks the PERM5 output
+    for (uint32_t X = 0; X < 32; X++)
+    {
+        for (uint32_t E = 0; E < 128; E++)
+        {
+            for (uint32_t F = 0; F < 128; F++)
+            {
+                for (uint32_t Y2 = 0; Y2 < 64; Y2++)
+                {
+                    uint8_t expected = SelectionKernelReference(X, 0, 0, 0, 0, E, F, 0, Y2);
+                    mismatches += SelectionKernel(X, 0, 0, 0, 0, E, F, 0, Y2) != expected ? 1 : 0;
+                    calls++;
+                }
+            }
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    printf("kernel pairs %llu %.2f s\n", static_cast<unsigned long long>(calls), seconds);
+
+    // both kernels over the same connection state like inputs
+    const uint32_t benchCount = 1 << 24;
+    uint32_t sink = 0;
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        start = std::chrono::steady_clock::now();
+        for (uint32_t clk = 0; clk < benchCount; clk++)
+        {
+            uint8_t X = (clk >> 2) & 0x1F;
+            uint8_t A = (0x13 ^ (clk >> 21)) & 0x1F;
+            uint8_t C = (0x15 ^ (clk >> 16)) & 0x1F;
+            uint16_t D = (0x1BB ^ (clk >> 7)) & 0x1FF;
+            uint8_t F = (16 * ((clk >> 7) & 0x1FFFFF)) % 79;
+            uint8_t Y1 = (clk >> 1) & 1;
+            sink += pass == 0 ? SelectionKernelReference(X, A, 0x2, C, D, 0x74, F, Y1, Y1 * 32) : SelectionKernel(X, A, 0x2, C, D, 0x74, F, Y1, Y1 * 32);
+        }
+        stop = std::chrono::steady_clock::now();
+        seconds = std::chrono::duration<double>(stop - start).count();
+        printf("%s %6.2f ns per slot\n", pass == 0 ? "reference" : "tables   ", seconds * 1e9 / benchCount);
+    }
+    volatile uint32_t keep = sink;
+    (void)keep;
+    return mismatches;
+}
+
+// HopSequence fields against the GetBit extraction TestHop used, and its
+// channels against the bit level kernel for every X and Y1, over random and
+// corner addresses
+uint32_t VerifyHopSequence()
+{
+    uint32_t mismatches = 0;
+    uint32_t random = 0x2A96EF25;
+    std::vector<uint32_t> addresses = { 0, 0xFFFFFFF, HopSequence::GIAC_ADDRESS, 0x6587CBA9 };
+    for (uint32_t i = 0; i < 20000; i++)
+    {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        addresses.push_back(random);
+    }
+    for (size_t i = 0; i < addresses.size(); i++)
+    {
+        uint32_t address = addresses[i];
+        HopSequence sequence(address);
+        uint8_t A = (address >> 23) & 0x1F;
+        uint8_t B = (address >> 19) & 0xF;
+        uint8_t C = (GetBit(address, 8, 4) | GetBit(address, 6, 3) | GetBit(address, 4, 2) | GetBit(address, 2, 1) | GetBit(address, 0, 0))  & 0x1F;
+        uint16_t D = (address >> 10) & 0x1FF;
+        uint8_t E = (GetBit(address, 13, 6) | GetBit(address, 11, 5) | GetBit(address, 9, 4) | GetBit(address, 7, 3) | GetBit(address, 5, 2) | GetBit(address, 3, 1) | GetBit(address, 1, 0))  & 0x7F;
+        mismatches += sequence.A() != A || sequence.B() != B || sequence.C() != C || sequence.D() != D || sequence.E() != E ? 1 : 0;
+        for (uint32_t X = 0; X < 32; X++)
+        {
+            mismatches += sequence.ScanChannel(X) != SelectionKernelReference(X, A, B, C, D, E, 0, 0, 0) ? 1 : 0;
+            for (uint32_t Y1 = 0; Y1 < 2; Y1++)
+            {
+                mismatches += sequence.TrainChannel(X, Y1) != SelectionKernelReference(X, A, B, C, D, E, 0, Y1, Y1 * 32) ? 1 : 0;
+            }
+        }
+    }
+
+    // page train of 256 tracked devices, one sequence each against the kernel per slot
+    std::vector<HopSequence> sequences;
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        sequences.push_back(HopSequence(addresses[i]));
+    }
+    const uint32_t slotCount = 1 << 16;
+    uint32_t sink = 0;
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t clk = 0; clk < slotCount; clk++)
+        {
+            uint8_t X = ((clk >> 12) + ((clk >> 1) & 0xE) + (clk & 1)) & 0x1F;
+            uint8_t Y1 = (clk >> 1) & 1;
+            for (size_t device = 0; device < sequences.size(); device++)
+            {
+                const HopSequence& sequence = sequences[device];
+                sink += pass == 0 ? SelectionKernel(X, sequence.A(), sequence.B(), sequence.C(), sequence.D(), sequence.E(), 0, Y1, Y1 * 32) : sequence.TrainChannel(X, Y1);
+            }
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        printf("%s %6.2f ns per device slot\n", pass == 0 ? "kernel        " : "hop sequence  ", seconds * 1e9 / slotCount / sequences.size());
+    }
+    volatile uint32_t keep = sink;
+    (void)keep;
+    return mismatches;
+}
+
+// The connection state kernel inputs straight from the address and clock bits
+static uint8_t BasicChannelReference(uint32_t address, uint32_t clk)
+{
+    uint8_t X = (clk >> 2) & 0x1F;
+    uint8_t Y1 = (clk >> 1) & 1;
+    uint8_t A = ((address >> 23) ^ (clk >> 21)) & 0x1F;
+    uint8_t B = (address >> 19) & 0xF;
+    uint8_t C = ((GetBit(address, 8, 4) | GetBit(address, 6, 3) | GetBit(address, 4, 2) | GetBit(address, 2, 1) | GetBit(address, 0, 0)) ^ (clk >> 16)) & 0x1F;
+    uint16_t D = ((address >> 10) ^ (clk >> 7)) & 0x1FF;
+    uint8_t E = (GetBit(address, 13, 6) | GetBit(address, 11, 5) | GetBit(address, 9, 4) | GetBit(address, 7, 3) | GetBit(address, 5, 2) | GetBit(address, 3, 1) | GetBit(address, 1, 0))  & 0x7F;
+    uint8_t F = (16 * ((clk >> 7) & 0x1FFFFF)) % 79;
+    return SelectionKernelReference(X, A, B, C, D, E, F, Y1, 32 * Y1);
+}
+
+// Fixed channels of 16 slots from clk, first for the basic channel and then
+// for the adapted channel under AFH_TEST_MAP. Address 0 below CLK7 is worked
+// by hand from the specification: A - F are 0, so the central slots have
+// PERM5 as the identity and channel 2 x X, the peripheral slots run the five
+// C butterflies on X and remap PERM5 + 32. Under the map only the odd
+// channels and the even ones from 60 are used, so every even 2 x X below 60 is
+// remapped to mapping table entry X, the table starting 60, 62 .. 78, 1, 3.
+// The other rows take the sample data addresses at CLK 0x10 and at a clock
+// with the bits above CLK7 set. They come from a derivation separate from
+// this file, with P13 - P9 = C ^ Y1 and P8 - P0 = D as libbtbb's perm5 takes
+// them, not from the Part G tables, which are still to be transcribed.
+struct HopVector
+{
+    uint32_t address;
+    uint32_t clk;
+    uint8_t channels[16];
+};
+
+static const uint8_t AFH_TEST_MAP[ChannelMap::MAP_SIZE] = { 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xFA, 0xFF, 0x7F };
+
+static const HopVector basicVectors[] =
+{
+    { 0x00000000, 0x0000010, { 8, 66, 10, 70, 12, 19, 14, 23, 16, 1, 18, 5, 20, 33, 22, 37 } },
+    { 0x2A96EF25, 0x0000010, { 55, 26, 19, 20, 23, 22, 53, 40, 57, 42, 21, 36, 25, 38, 27, 63 } },
+    { 0x6587CBA9, 0x0000010, { 20, 60, 53, 62, 55, 66, 6, 64, 8, 68, 57, 70, 59, 74, 10, 72 } },
+    { 0x2A96EF25, 0x3B5A8C0, { 29, 65, 45, 2, 21, 63, 37, 0, 33, 18, 49, 34, 25, 16, 41, 32 } },
+    { 0x6587CBA9, 0x3B5A8C0, { 6, 32, 10, 36, 45, 54, 49, 58, 77, 56, 2, 60, 61, 62, 65, 66 } },
+};
+
+static const HopVector adaptedVectors[] =
+{
+    { 0x00000000, 0x0000010, { 68, 68, 70, 70, 72, 72, 74, 74, 76, 76, 78, 78, 1, 1, 3, 3 } },
+    { 0x2A96EF25, 0x0000010, { 55, 55, 19, 19, 23, 23, 53, 53, 57, 57, 21, 21, 25, 25, 27, 27 } },
+    { 0x6587CBA9, 0x0000010, { 61, 61, 53, 53, 55, 55, 47, 47, 49, 49, 57, 57, 59, 59, 51, 51 } },
+    { 0x2A96EF25, 0x3B5A8C0, { 29, 29, 45, 45, 21, 21, 37, 37, 33, 33, 49, 49, 25, 25, 41, 41 } },
+    { 0x6587CBA9, 0x3B5A8C0, { 70, 70, 74, 74, 45, 45, 49, 49, 77, 77, 66, 66, 61, 61, 65, 65 } },
+};
+
+// basicVectors, then BasicChannels against the bit level kernel slot by slot, for runs of every
+// length around the 64 slot blocks, odd and unaligned starts and the 28 bit
+// clock wrap, then an hour of slots against SelectionKernel per slot
+uint32_t VerifyBasicChannels()
+{
+    uint32_t mismatches = 0;
+    for (size_t vector = 0; vector < sizeof(basicVectors) / sizeof(basicVectors[0]); vector++)
+    {
+        const HopVector& expected = basicVectors[vector];
+        uint8_t channels[16];
+        HopSequence(expected.address).BasicChannels(expected.clk, channels, 16);
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            mismatches += channels[i] != expected.channels[i] ? 1 : 0;
+            mismatches += BasicChannelReference(expected.address, expected.clk + 2 * i) != expected.channels[i] ? 1 : 0;
+        }
+    }
+    uint32_t random = 0x6587CBA9;
+    const uint32_t counts[] = { 0, 1, 2, 63, 64, 65, 127, 128, 129, 1000, 4097 };
+    std::vector<uint8_t> channels(1 << 16);
+    for (uint32_t run = 0; run < 2000; run++)
+    {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        uint32_t address = run == 0 ? 0 : run == 1 ? 0xFFFFFFF : random;
+        uint32_t clkStart = random * 2654435761u;
+        if (run % 4 == 1)
+        {
+            // a run across the clock wrap
+            clkStart = HopSequence::CLOCK_MASK - (random & 0x3FF);
+        }
+        size_t count = run < 64 ? counts[run % (sizeof(counts) / sizeof(counts[0]))] : random % 3000;
+
+        HopSequence sequence(address);
+        sequence.BasicChannels(clkStart, channels.data(), count);
+        uint32_t clk = clkStart & (HopSequence::CLOCK_MASK & ~1u);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t expected = BasicChannelReference(address, clk);
+            mismatches += channels[i] != expected ? 1 : 0;
+            mismatches += sequence.BasicChannel(clk) != expected ? 1 : 0;
+            clk = (clk + 2) & HopSequence::CLOCK_MASK;
+        }
+    }
+
+    // one hour of slots at 1600 per second
+    HopSequence sequence(0x6587CBA9);
+    const uint32_t slotCount = 1600 * 3600;
+    uint32_t sink = 0;
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t done = 0; done < slotCount; done += channels.size())
+        {
+            uint32_t clk = 2 * done;
+            size_t count = slotCount - done < channels.size() ? slotCount - done : channels.size();
+            if (pass == 0)
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    channels[i] = sequence.BasicChannel(clk + 2 * static_cast<uint32_t>(i));
+                }
+            }
+            else
+            {
+                sequence.BasicChannels(clk, channels.data(), count);
+            }
+            sink += channels[count - 1];
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        printf("%s %6.2f ns per slot\n", pass == 0 ? "per slot kernel" : "basic channels ", seconds * 1e9 / slotCount);
+    }
+    volatile uint32_t keep = sink;
+    (void)keep;
+    return mismatches;
+}
+
+// The adapted channel as the specification describes it: the mapping table,
+// even used channels ascending then odd ones, gathered from the map bits on
+// every call, PERM5 out of the bit level kernel
+// with E, F and Y2 at 0, where the remap 2 x PERM5 is undone by halving
+static uint8_t AdaptedChannelReference(uint32_t address, uint32_t clk, const uint8_t* map)
+{
+    uint8_t usedChannels[79];
+    uint32_t usedCount = 0;
+    for (uint32_t i = 0; i < 79; i++)
+    {
+        uint32_t channel = (i * 2) % 79;
+        if ((map[channel / 8] >> (channel % 8)) & 1)
+        {
+            usedChannels[usedCount++] = static_cast<uint8_t>(channel);
+        }
+    }
+    uint8_t X = (clk >> 2) & 0x1F;
+    uint8_t A = ((address >> 23) ^ (clk >> 21)) & 0x1F;
+    uint8_t B = (address >> 19) & 0xF;
+    uint8_t C = ((GetBit(address, 8, 4) | GetBit(address, 6, 3) | GetBit(address, 4, 2) | GetBit(address, 2, 1) | GetBit(address, 0, 0)) ^ (clk >> 16)) & 0x1F;
+    uint16_t D = ((address >> 10) ^ (clk >> 7)) & 0x1FF;
+    uint8_t E = (GetBit(address, 13, 6) | GetBit(address, 11, 5) | GetBit(address, 9, 4) | GetBit(address, 7, 3) | GetBit(address, 5, 2) | GetBit(address, 3, 1) | GetBit(address, 1, 0))  & 0x7F;
+    uint32_t clk27_7 = (clk >> 7) & 0x1FFFFF;
+    uint8_t F = (16 * clk27_7) % 79;
+    uint8_t channel = SelectionKernelReference(X, A, B, C, D, E, F, 0, 0);
+    if ((map[channel / 8] >> (channel % 8)) & 1)
+    {
+        return channel;
+    }
+    uint32_t perm = SelectionKernelReference(X, A, B, C, D, 0, 0, 0, 0) / 2;
+    uint32_t Fprime = (16 * clk27_7) % usedCount;
+    return usedChannels[(perm + E + Fprime) % usedCount];
+}
+
+// adaptedVectors, then AdaptedChannels against the reference for random maps from MIN_USED to 79
+// used channels, runs as VerifyBasicChannels picks them, and ChannelMap::Set
+// refusing short maps. Then an hour of slots with the map changing every
+// second, against the reference per slot for the first minute
+uint32_t VerifyAdaptedChannels()
+{
+    uint32_t mismatches = 0;
+    uint32_t random = 0x2A96EF25;
+    std::vector<uint8_t> channels(1 << 16);
+    ChannelMap testMap;
+    uint8_t map[ChannelMap::MAP_SIZE];
+    mismatches += testMap.Set(AFH_TEST_MAP) ? 0 : 1;
+    for (size_t vector = 0; vector < sizeof(adaptedVectors) / sizeof(adaptedVectors[0]); vector++)
+    {
+        const HopVector& expected = adaptedVectors[vector];
+        uint8_t channels[16];
+        HopSequence(expected.address).AdaptedChannels(expected.clk, testMap, channels, 16);
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            mismatches += channels[i] != expected.channels[i] ? 1 : 0;
+            mismatches += AdaptedChannelReference(expected.address, expected.clk + 2 * i, AFH_TEST_MAP) != expected.channels[i] ? 1 : 0;
+        }
+    }
+    for (uint32_t run = 0; run < 2000; run++)
+    {
+        // a map with usedCount channels at random
+        uint32_t usedCount = ChannelMap::MIN_USED + run % (80 - ChannelMap::MIN_USED);
+        memset(map, 0, sizeof(map));
+        for (uint32_t used = 0; used < usedCount;)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            uint32_t channel = random % 79;
+            used += ((map[channel / 8] >> (channel % 8)) & 1) ? 0 : 1;
+            map[channel / 8] |= 1 << (channel % 8);
+        }
+        if (run % 3 == 0)
+        {
+            // the reserved bit 79 is ignored
+            map[ChannelMap::MAP_SIZE - 1] |= 0x80;
+        }
+        mismatches += testMap.Set(map) ? 0 : 1;
+        mismatches += testMap.UsedCount() != usedCount ? 1 : 0;
+
+        uint32_t address = run == 0 ? 0 : run == 1 ? 0xFFFFFFF : random;
+        uint32_t clkStart = run % 4 == 1 ? HopSequence::CLOCK_MASK - (random & 0x3FF) : random * 2654435761u;
+        size_t count = random % 3000;
+        HopSequence sequence(address);
+        sequence.AdaptedChannels(clkStart, testMap, channels.data(), count);
+        uint32_t clk = clkStart & (HopSequence::CLOCK_MASK & ~1u);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t expected = AdaptedChannelReference(address, clk, map);
+            mismatches += channels[i] != expected ? 1 : 0;
+            mismatches += sequence.AdaptedChannel(clk, testMap) != expected ? 1 : 0;
+            clk = (clk + 2) & HopSequence::CLOCK_MASK;
+        }
+    }
+    // a map under Nmin leaves the last map in place
+    uint8_t lastMap[ChannelMap::MAP_SIZE];
+    memcpy(lastMap, testMap.GetMap(), sizeof(lastMap));
+    memset(map, 0, sizeof(map));
+    map[0] = 0xFF;
+    map[1] = 0xFF;
+    map[2] = 0x07;
+    mismatches += testMap.Set(map) ? 1 : 0;
+    mismatches += memcmp(lastMap, testMap.GetMap(), sizeof(lastMap)) != 0 ? 1 : 0;
+    map[2] = 0x0F;
+    mismatches += testMap.Set(map) ? 0 : 1;
+    mismatches += testMap.UsedCount() != ChannelMap::MIN_USED ? 1 : 0;
+
+    // one hour of slots, a new map every second
+    HopSequence sequence(0x6587CBA9);
+    const uint32_t slotsPerMap = 1600;
+    const uint32_t slotCount = 1600 * 3600;
+    uint32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t done = 0; done < slotCount; done += slotsPerMap)
+    {
+        // 20 - 79 used channels, the window moving along the band
+        memset(map, 0, sizeof(map));
+        uint32_t first = (done / slotsPerMap) % 79;
+        uint32_t usedCount = ChannelMap::MIN_USED + (done / slotsPerMap) % (80 - ChannelMap::MIN_USED);
+        for (uint32_t used = 0; used < usedCount; used++)
+        {
+            uint32_t channel = (first + used) % 79;
+            map[channel / 8] |= 1 << (channel % 8);
+        }
+        testMap.Set(map);
+        sequence.AdaptedChannels(2 * done, testMap, channels.data(), slotsPerMap);
+        if (done < 1600 * 60)
+        {
+            for (uint32_t i = 0; i < slotsPerMap; i += 7)
             {
-                printf("X %08X A %08X B %08X C %08X D %08X E %08X F %08X ADDR %08X\n", X, A, B, C, D, E, F, address);
+                mismatches += channels[i] != AdaptedChannelReference(0x6587CBA9, 2 * (done + i), map) ? 1 : 0;
             }
         }
+        sink += channels[slotsPerMap - 1];
     }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    printf("adapted channels %6.2f ns per slot, map changed every %u slots\n", seconds * 1e9 / slotCount, slotsPerMap);
 
+    const uint32_t changeCount = 1 << 20;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t change = 0; change < changeCount; change++)
+    {
+        map[change % 9] ^= static_cast<uint8_t>(1 << (change % 7));
+        sink += testMap.Set(map) ? testMap.UsedCount() : 0;
+    }
+    stop = std::chrono::steady_clock::now();
+    seconds = std::chrono::duration<double>(stop - start).count();
+    printf("map change       %6.2f ns\n", seconds * 1e9 / changeCount);
+    volatile uint32_t keep = sink;
+    (void)keep;
+    return mismatches;
 }
 
+// Every level this CPU runs against SelectionKernel per candidate, on random
+// bytes including the bits above each field width, for every count up to 100
+// so the scalar tail after the vector blocks is covered. The in range
+// candidates are also checked against the bit level kernel. Then thousands of
+// connection state candidates per slot, each level against the scalar loop.
+uint32_t VerifySelectionKernelSimd()
+{
+    uint32_t mismatches = 0;
+    uint32_t random = 0x9E8B33;
+    const size_t candidateCount = 4096;
+    std::vector<uint8_t> inputs[8];
+    std::vector<uint16_t> D(candidateCount);
+    for (uint32_t input = 0; input < 8; input++)
+    {
+        inputs[input].resize(candidateCount);
+    }
+    std::vector<uint8_t> channels(candidateCount);
+    SelectionKernelInputs in = { inputs[0].data(), inputs[1].data(), inputs[2].data(), inputs[3].data(), D.data(),
+        inputs[4].data(), inputs[5].data(), inputs[6].data(), inputs[7].data() };
+    std::vector<SimdLevel> levels = { SimdLevel::Scalar };
+    if (SelectionKernelSimd::Best() != SimdLevel::Scalar)
+    {
+        levels.push_back(SimdLevel::Sse2);
+    }
+    if (SelectionKernelSimd::Best() == SimdLevel::Avx2)
+    {
+        levels.push_back(SimdLevel::Avx2);
+    }
 
+    for (uint32_t run = 0; run < 400; run++)
+    {
+        // odd runs keep every input in its field width
+        bool inRange = (run & 1) != 0;
+        const uint8_t widths[8] = { 0x1F, 0x1F, 0xF, 0x1F, 0x7F, 0x7F, 1, 0 };
+        for (size_t i = 0; i < candidateCount; i++)
+        {
+            for (uint32_t input = 0; input < 8; input++)
+            {
+                random ^= random << 13;
+                random ^= random >> 17;
+                random ^= random << 5;
+                inputs[input][i] = static_cast<uint8_t>(inRange ? random & widths[input] : random);
+            }
+            D[i] = static_cast<uint16_t>(inRange ? (random >> 8) & 0x1FF : random >> 8);
+            if (inRange)
+            {
+                inputs[7][i] = 32 * inputs[6][i];
+            }
+        }
+        size_t count = run < 202 ? run / 2 : candidateCount;
+        for (size_t level = 0; level < levels.size(); level++)
+        {
+            memset(channels.data(), 0xFF, channels.size());
+            SelectionKernelSimd::Run(in, channels.data(), count, levels[level]);
+            for (size_t i = 0; i < count; i++)
+            {
+                uint8_t expected = SelectionKernel(in.X[i], in.A[i], in.B[i], in.C[i], in.D[i], in.E[i], in.F[i], in.Y1[i], in.Y2[i]);
+                mismatches += channels[i] != expected ? 1 : 0;
+                if (inRange && level == 0)
+                {
+                    mismatches += expected != SelectionKernelReference(in.X[i], in.A[i], in.B[i], in.C[i], in.D[i], in.E[i], in.F[i], in.Y1[i], in.Y2[i]) ? 1 : 0;
+                }
+            }
+            // nothing written past count
+            mismatches += count < candidateCount && channels[count] != 0xFF ? 1 : 0;
+        }
+    }
+
+    // candidateCount (address, clock) pairs in the connection state, a slot at a time
+    std::vector<HopSequence> sequences;
+    std::vector<uint32_t> clocks;
+    for (size_t i = 0; i < candidateCount; i++)
+    {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        sequences.push_back(HopSequence(random));
+        clocks.push_back((random * 2654435761u) & HopSequence::CLOCK_MASK & ~1u);
+    }
+    const uint32_t slotCount = 2000;
+    for (size_t level = 0; level <= levels.size(); level++)
+    {
+        uint32_t sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t slot = 0; slot < slotCount; slot++)
+        {
+            for (size_t i = 0; i < candidateCount; i++)
+            {
+                uint32_t clk = clocks[i] + 2 * slot;
+                uint32_t block = (clk >> 7) & 0x1FFFFF;
+                const HopSequence& sequence = sequences[i];
+                inputs[0][i] = (clk >> 2) & 0x1F;
+                inputs[1][i] = (sequence.A() ^ (block >> 14)) & 0x1F;
+                inputs[2][i] = sequence.B();
+                inputs[3][i] = (sequence.C() ^ (block >> 9)) & 0x1F;
+                D[i] = (sequence.D() ^ block) & 0x1FF;
+                inputs[4][i] = sequence.E();
+                inputs[5][i] = (16 * block) % 79;
+                inputs[6][i] = (clk >> 1) & 1;
+                inputs[7][i] = 32 * inputs[6][i];
+            }
+            if (level == 0)
+            {
+                for (size_t i = 0; i < candidateCount; i++)
+                {
+                    channels[i] = SelectionKernel(in.X[i], in.A[i], in.B[i], in.C[i], in.D[i], in.E[i], in.F[i], in.Y1[i], in.Y2[i]);
+                }
+            }
+            else
+            {
+                SelectionKernelSimd::Run(in, channels.data(), candidateCount, levels[level - 1]);
+            }
+            for (size_t i = 0; i < candidateCount; i += 61)
+            {
+                mismatches += channels[i] != sequences[i].BasicChannel(clocks[i] + 2 * slot) ? 1 : 0;
+            }
+            sink += channels[candidateCount - 1];
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        printf("%-15s %6.2f us per slot of %zu candidates, inputs included\n", level == 0 ? "kernel loop" : SelectionKernelSimd::Name(levels[level - 1]),
+            seconds * 1e6 / slotCount, candidateCount);
+        volatile uint32_t keep = sink;
+        (void)keep;
+    }
+
+    // the kernel alone on the last slot's inputs
+    const uint32_t repeatCount = 4000;
+    for (size_t level = 0; level < levels.size(); level++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t repeat = 0; repeat < repeatCount; repeat++)
+        {
+            SelectionKernelSimd::Run(in, channels.data(), candidateCount, levels[level]);
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        printf("%-15s %6.2f ns per candidate\n", SelectionKernelSimd::Name(levels[level]), seconds * 1e9 / repeatCount / candidateCount);
+    }
+    return mismatches;
+}
 
-uint8_t SelectionKernel(uint8_t X, uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint8_t E, uint8_t F, uint8_t Y1, uint8_t Y2)
+// bit level kernel as the specification draws it, the tables are checked against it
+uint8_t SelectionKernelReference(uint8_t X, uint8_t A, uint8_t B, uint8_t C, uint16_t D, uint8_t E, uint8_t F, uint8_t Y1, uint8_t Y2)
 {
     uint8_t butterFlyLut[] =
     {//       PAB
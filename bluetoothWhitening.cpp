@@ -1,10 +1,37 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
 #include "BluetoothWhitening.h"
+#include "BluetoothCrc.h"
+#include "BluetoothHec.h"
+#include "BluetoothFec23.h"
+#include "BluetoothFec13.h"
+#include "UapRecovery.h"
+#include "ClockRecovery.h"
+#include "PacketDecoder.h"
+#include "BatchProcessor.h"
+#include "MappedFile.h"
+#include "HexParser.h"
+#include "StreamProcessor.h"
+#include "PcapFile.h"
+#include "OutputWriter.h"
 #include "LinearFeedbackShiftRegister.h"
 
 #include <vector>
 #include <string>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <new>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#endif
 
 #ifndef _WIN32
 int fopen_s(FILE** pFile, const char *filename, const char *mode)
@@ -25,71 +52,127 @@ int fopen_s(FILE** pFile, const char *filename, const char *mode)
 
 void TestHop();
 
+#ifdef BTWHITE_ALLOCATION_COUNT
+// Test builds only, btwhite_test from build.sh and the Debug configurations.
+// Every heap allocation in the process goes through here so --z can prove a
+// path never allocates.
+static std::atomic<size_t> heapAllocationCount(0);
+
+// Kept out of line, so the compiler does not pair the malloc behind operator
+// new with a free it inlines from operator delete and warn about a mismatch
+#if defined(_MSC_VER)
+#define ALLOCATION_NOINLINE __declspec(noinline)
+#else
+#define ALLOCATION_NOINLINE __attribute__((noinline))
+#endif
+
+static ALLOCATION_NOINLINE void* CountedAllocation(size_t size)
+{
+    heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+static ALLOCATION_NOINLINE void CountedRelease(void* ptr)
+{
+    free(ptr);
+}
+
+void* operator new(size_t size)
+{
+    void* ptr = CountedAllocation(size);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAllocation(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedAllocation(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    CountedRelease(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    CountedRelease(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    CountedRelease(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    CountedRelease(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    CountedRelease(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    CountedRelease(ptr);
+}
+#endif
+
 const char* unitTestWhitening =
     "unitTestWhitening "
     "60 "
     "10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09 "
     "--e "
     "6F 0C 00 8B C1 04 C9 37 EE B3 41 43 19 44 55 DF CB 4D D0 42 A6 ";
-class BluetoothWhitening
-{
-public:
-    BluetoothWhitening(uint32_t clock)
-        :lsfr(7, 0x40 | ((clock >> 1) & 0x3F))
-    {
-        // poly from bluetooth spec for whitening
-        lsfr.AddGaloisPoly(0x91);
-        // standard generator, only including output of the final register
-        lsfr.AddGeneratorPoly(0x40);
-    }
-
-    void WhitenData(std::vector<uint8_t>& dataIn, std::vector<uint8_t>& dataOut)
-    {
-        const size_t HEADER_SIZE_BITS = 18;
-        const uint8_t BIT_MASK_TABLE[7] =
-        {
-            0x01,
-            0x03,
-            0x07,
-            0x0F,
-            0x1F,
-            0x3F,
-            0x7F,
-        };
-        dataOut.resize(dataIn.size());
-        size_t dataIndex = 0;
-
-//        printf("Header:\n");
-        lsfr.Shift(HEADER_SIZE_BITS);
-        auto whiteningCodeHeader = lsfr.GetDataOut(0);
-        for (; dataIndex < HEADER_SIZE_BITS/8; dataIndex++)
-        {
-            dataOut[dataIndex] = dataIn[dataIndex] ^ whiteningCodeHeader[dataIndex];
-//            printf("data[%2zu] %02X -> %02X\n", dataIndex, dataIn[dataIndex], dataOut[dataIndex]);
-        }
-        uint8_t lastByteBits = HEADER_SIZE_BITS & 0x7;
-        if (lastByteBits != 0)
-        {
-            dataOut[dataIndex] = (dataIn[dataIndex] ^ whiteningCodeHeader[dataIndex]) & BIT_MASK_TABLE[lastByteBits - 1];
-//            printf("data[%2zu] %02X -> %02X\n", dataIndex, dataIn[dataIndex], dataOut[dataIndex]);
-        }
-        dataIndex++;
+const char* unitTestWhiteningPayload =
+    "unitTestWhiteningPayload "
+    "--p "
+    "60 "
+    "C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09 "
+    "--e "
+    "8B C1 04 C9 37 EE B3 41 43 19 44 55 DF CB 4D D0 42 A6 ";
 
-//        printf("Data:\n");
-        lsfr.ClearDataOut(0, false);
-        lsfr.Shift(static_cast<uint32_t>((dataIn.size() - dataIndex) * 8));
-        auto whiteningCodeData = lsfr.GetDataOut(0);
-        for (int whiteningIndex = 0; dataIndex < dataIn.size(); dataIndex++, whiteningIndex++)
-        {
-            dataOut[dataIndex] = dataIn[dataIndex] ^ whiteningCodeData[whiteningIndex];
-//            printf("data[%2zu] %02X -> %02X\n", dataIndex, dataIn[dataIndex], dataOut[dataIndex]);
-        }
-    }
+const char* unitTestWhiteningNoAlloc =
+    "unitTestWhiteningNoAlloc "
+    "--z "
+    "60 "
+    "10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09 "
+    "--e "
+    "6F 0C 00 8B C1 04 C9 37 EE B3 41 43 19 44 55 DF CB 4D D0 42 A6 ";
 
-private:
+const char* unitTestWhiteningBits =
+    "unitTestWhiteningBits "
+    "--w "
+    "--bl 162 "
+    "60 "
+    "10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09 "
+    "--e "
+    "6F 0C 28 BC 8B 5B 4C C1 72 29 80 95 DC 00 75 86 15 AC 5F 59 0B ";
 
-    LinearFeedbackShiftRegister lsfr;
-};
+const char* unitTestWhiteningBitsOffset =
+    "unitTestWhiteningBitsOffset "
+    "--w "
+    "--bo 5 "
+    "--bl 140 "
+    "60 "
+    "10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09 "
+    "--e "
+    "F0 5F 1B 64 31 C3 44 E5 B9 12 7C E4 7F F4 20 EE DA 05 CA E7 09 ";
 
 const char* unitTestHec =
 "unitTestHec "
@@ -117,36 +200,61 @@ const char* unitTestHec =
 "47 1F 01 "
 "--e "
 "E1 06 32 D5 5A BD E2 05 8A 6D 9E 79 4D AA 25 C2 9D 7A F5 12 ";
-class BluetoothHec
-{
-public:
-    const uint32_t bluetoothHecPoly = 0x1A7;
-    const uint32_t bluetoothHecRegCnt = 8;
-    const uint32_t bluetoothHecPayloadBitCnt = 10;
-
-    BluetoothHec(uint8_t uap)
-        :lsfr(bluetoothHecRegCnt, uap)
-    {
-        // poly from bluetooth spec for whitening
-        lsfr.AddGaloisPoly(bluetoothHecPoly);
-        // standard generator, only including output of the final register
-        lsfr.AddGeneratorPoly(1 << (bluetoothHecRegCnt - 1));
-        lsfr.AddInputPoly(bluetoothHecPoly);
-    }
-
-    void CalcHec(uint8_t uap, std::vector<uint8_t>& dataIn, uint8_t& hecVal)
-    {
-        lsfr.Reset(uap);
-        lsfr.Shift(bluetoothHecPayloadBitCnt, dataIn);
-
-        hecVal = (uint8_t)lsfr.GetState();
-    }
-
-private:
+const char* unitTestHecQuiet =
+"unitTestHecQuiet "
+"--q "
+"--hec "
+"47 "
+"00 23 01 "
+"--e "
+"E1 ";
 
-    LinearFeedbackShiftRegister lsfr;
-};
+const char* unitTestHecTable =
+"unitTestHecTable "
+"--hv "
+"5A "
+"--e "
+"00 ";
 
+const char* unitTestUapRecovery =
+"unitTestUapRecovery "
+"--uap "
+"00 "
+"10 EE 88 00 00 "
+"2A 1E BE 02 00 "
+"7E 16 5F 01 00 "
+"36 60 54 02 0C 06 97 75 FB E7 43 EF AC D8 97 3E E1 "
+"--e "
+"47 05 ";
+
+const char* unitTestClockRecovery =
+"unitTestClockRecovery "
+"--k "
+"--ua 47 "
+"00 EE 88 00 "
+"1A 1E BE 02 "
+"6E 16 5F 01 "
+"--e "
+"10 ";
+
+const char* unitTestClockUapRecovery =
+"unitTestClockUapRecovery "
+"--k "
+"00 EE 88 00 "
+"1A 1E BE 02 "
+"6E 16 5F 01 "
+"--e "
+"10 47 50 91 ";
+
+const char* unitTestClockUapRecoveryQuiet =
+"unitTestClockUapRecoveryQuiet "
+"--q "
+"--k "
+"00 EE 88 00 "
+"1A 1E BE 02 "
+"6E 16 5F 01 "
+"--e "
+"10 47 50 91 ";
 
 const char* unitTestCrc =
 "unitTestCrc "
@@ -155,34 +263,20 @@ const char* unitTestCrc =
 "4E 01 02 03 04 05 06 07 08 09 "
 "--e "
 "6D D2 ";
-class BluetoothCrc
-{
-public:
-    const uint32_t bluetoothCrcPoly = 0x11021;
-    const uint32_t bluetoothCrcRegCnt = 16;
-
-    BluetoothCrc(uint8_t uap)
-        :lsfr(bluetoothCrcRegCnt, uap)
-    {
-        // poly from bluetooth spec for whitening
-        lsfr.AddGaloisPoly(bluetoothCrcPoly);
-        // standard generator, only including output of the final register
-        lsfr.AddGeneratorPoly(1 << (bluetoothCrcRegCnt - 1));
-        lsfr.AddInputPoly(bluetoothCrcPoly);
-    }
-
-    void CalcCrc(std::vector<uint8_t>& dataIn, uint16_t& crcVal)
-    {
-        lsfr.Shift(static_cast<uint32_t>(dataIn.size() * 8), dataIn);
-
-        crcVal = (uint16_t)lsfr.GetState();
-//        crcVal = lsfr.GetDataOut(0)[dataIn.size()] | lsfr.GetDataOut(0)[dataIn.size() + 1] << 8;
-    }
-
-private:
-
-    LinearFeedbackShiftRegister lsfr;
-};
+const char* unitTestCrcBinary =
+"unitTestCrcBinary "
+"--bin "
+"--c "
+"47 "
+"4E 01 02 03 04 05 06 07 08 09 "
+"--e "
+"6D D2 ";
+const char* unitTestCrcRandom =
+"unitTestCrcRandom "
+"--cv "
+"5A "
+"--e "
+"00 ";
 
 const char* unitTestFec23 =
 "unitTestFec23 "
@@ -191,184 +285,2385 @@ const char* unitTestFec23 =
 "01 00 02 00 04 00 08 00 10 00 20 00 40 00 80 00 00 01 00 02 "
 "--e "
 "0B 16 07 0E 1C 13 0D 1A 1F 15 ";
-class BluetoothFec23
+const char* unitTestFec23Binary =
+"unitTestFec23Binary "
+"--bin "
+"--f "
+"00 "
+"01 00 02 00 "
+"--e "
+"0B 16 ";
+const char* unitTestFec23Decode =
+"unitTestFec23Decode "
+"--fd "
+"00 "
+"2B C5 68 23 1B 0A "
+"--e "
+"23 45 CB 06 02 01 ";
+
+const char* unitTestFec23Random =
+"unitTestFec23Random "
+"--fv "
+"5A "
+"--e "
+"00 ";
+
+const char* unitTestFec13 =
+"unitTestFec13 "
+"--f13 "
+"60 "
+"EF 8F 1F C0 0E 00 08 "
+"--e "
+"10 D0 00 03 ";
+
+const char* unitTestFec13Random =
+"unitTestFec13Random "
+"--f13v "
+"5A "
+"--e "
+"00 ";
+
+const char* unitTestSyncWord =
+"unitTestSyncWord "
+"--sync "
+"00 "
+"33 8B 9E "
+"--e "
+"E2 3A 1A 33 CE 2C 7A 4E ";
+
+const char* unitTestPacketDecode =
+"unitTestPacketDecode "
+"--pkt "
+"60 "
+"21 4F 6C 47 "
+"92 51 E2 8C A1 F8 C2 9E D8 58 C5 0B FC C7 71 00 38 C8 9E 25 30 D7 92 F0 AB DE D0 30 62 20 01 "
+"--e "
+"99 D6 01 07 48 65 6C 6C 6F ";
+
+const char* unitTestPacketDecodeRandom =
+"unitTestPacketDecodeRandom "
+"--pktv "
+"5A "
+"--e "
+"00 ";
+
+const char* unitTestBatch =
+"unitTestBatch "
+"--batch "
+"--threads 4 "
+"60 00 00 00 15 00 10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09 "
+"60 00 00 00 03 00 10 D0 00 "
+"--e "
+"60 00 00 00 15 00 6F 0C 00 8B C1 04 C9 37 EE B3 41 43 19 44 55 DF CB 4D D0 42 A6 "
+"60 00 00 00 03 00 6F 0C 00 ";
+
+const char* unitTestBatchRandom =
+"unitTestBatchRandom "
+"--batchv "
+"5A "
+"--e "
+"00 ";
+
+const char* unitTestStreamRandom =
+"unitTestStreamRandom "
+"--streamv "
+"5A "
+"--e "
+"00 ";
+
+const char* unitTestPcapRandom =
+"unitTestPcapRandom "
+"--pcapv "
+"5A "
+"--e "
+"00 ";
+
+const char* unitTestOutputWriter =
+"unitTestOutputWriter "
+"--outv "
+"5A "
+"--e "
+"00 ";
+
+const char* unitTestHexParser =
+"unitTestHexParser "
+"--hexv "
+"5A "
+"--e "
+"00 ";
+
+const char* unitTestLfsr =
+"unitTestLfsr "
+"--l "
+"5A "
+"--e "
+"00 ";
+
+static uint32_t XorShift32(uint32_t& state)
 {
-public:
-    const uint32_t bluetoothFec23Poly = 0x35;
-    const uint32_t bluetoothFec23RegCnt = 5;
-    const uint32_t bluetoothFec23PayloadBitCnt = 10;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
 
-    BluetoothFec23()
-        :lsfr(bluetoothFec23RegCnt, 0)
-    {
-        // poly from bluetooth spec for whitening
-        lsfr.AddGaloisPoly(bluetoothFec23Poly);
-        // standard generator, only including output of the final register
-        lsfr.AddGeneratorPoly(1 << (bluetoothFec23RegCnt - 1));
-        lsfr.AddInputPoly(bluetoothFec23Poly);
-    }
+// Runs the serial engine alongside the word parallel and byte table engines over
+// pseudo random register sizes, polys, seeds and input data. Returns the number
+// of mismatches.
+static uint32_t VerifyLfsrEngines(uint32_t randSeed)
+{
+    const LfsrEngine engines[] = { LfsrEngine::Serial, LfsrEngine::WordParallel, LfsrEngine::ByteTable };
+    const size_t engineCount = sizeof(engines) / sizeof(engines[0]);
+    uint32_t rng = randSeed | 0x80000000;
+    uint32_t mismatches = 0;
 
-    void CalcParity(std::vector<uint8_t>& dataIn, uint8_t& parity)
+    // a 32 register generator makes the serial engine read past its registers, stop at 31
+    for (uint32_t regCnt = 1; regCnt < 32; regCnt++)
     {
-        lsfr.ClearDataOut(0);
-        for (int i = 0; i < 10; i++)
+        const uint32_t regMask = (1u << regCnt) - 1;
+        for (uint32_t trial = 0; trial < 8; trial++)
         {
-            lsfr.Shift(bluetoothFec23PayloadBitCnt, dataIn);
+            uint32_t initState = XorShift32(rng) & regMask;
+            std::vector<LinearFeedbackShiftRegister> lfsrs;
+            for (size_t engine = 0; engine < engineCount; engine++)
+            {
+                lfsrs.emplace_back(regCnt, initState, engines[engine]);
+            }
+
+            uint32_t galoisPoly = XorShift32(rng);
+            uint32_t inputPoly = (trial & 1) ? XorShift32(rng) : 0;
+            uint32_t genPolys[4];
+            for (uint32_t genIndex = 0; genIndex < 4; genIndex++)
+            {
+                genPolys[genIndex] = XorShift32(rng) & regMask;
+            }
+            for (auto& lfsr : lfsrs)
+            {
+                lfsr.AddGaloisPoly(galoisPoly);
+                lfsr.AddInputPoly(inputPoly);
+                for (uint32_t genIndex = 0; genIndex < 1 + (trial & 3); genIndex++)
+                {
+                    lfsr.AddGeneratorPoly(genPolys[genIndex]);
+                }
+            }
+
+            std::vector<uint8_t> payload(XorShift32(rng) & 0x3F);
+            for (size_t i = 0; i < payload.size(); i++)
+            {
+                payload[i] = XorShift32(rng) & 0xFF;
+            }
+            // an aligned first run exercises the byte tables, an odd one the bit fallback
+            uint32_t firstBitCount = XorShift32(rng) & ((trial & 2) ? 0x1F8 : 0x1FF);
+            uint32_t secondBitCount = XorShift32(rng) & 0x1FF;
+            for (auto& lfsr : lfsrs)
+            {
+                lfsr.Shift(firstBitCount, payload);
+                lfsr.Shift(secondBitCount, payload);
+            }
+
+            for (size_t engine = 1; engine < engineCount; engine++)
+            {
+                mismatches += lfsrs[0].GetState() != lfsrs[engine].GetState() ? 1 : 0;
+                for (uint32_t genIndex = 0; genIndex < lfsrs[0].GetGeneratorCount(); genIndex++)
+                {
+                    mismatches += lfsrs[0].GetDataOut(genIndex) != lfsrs[engine].GetDataOut(genIndex) ? 1 : 0;
+                }
+            }
 
-            parity = (uint8_t)lsfr.GetState();
-            printf("bit %2u state %02X\n", i, parity);
+            // jumping ahead must land where shifting zero input bits does
+            uint64_t jumpBitCount = XorShift32(rng) & 0xFFF;
+            for (auto& lfsr : lfsrs)
+            {
+                lfsr.Reset(initState);
+            }
+            lfsrs[0].Shift(static_cast<uint32_t>(jumpBitCount));
+            uint32_t shiftedState = lfsrs[0].GetState();
+            lfsrs[0].Reset(initState);
+            for (auto& lfsr : lfsrs)
+            {
+                lfsr.JumpAhead(jumpBitCount);
+                mismatches += lfsr.GetState() != shiftedState ? 1 : 0;
+            }
         }
-        //        crcVal = lsfr.GetDataOut(0)[dataIn.size()] | lsfr.GetDataOut(0)[dataIn.size() + 1] << 8;
     }
+    return mismatches;
+}
 
-private:
+// Whitens every clock with the keystream cache and with a freshly seeded LFSR,
+// returns the number of mismatching clocks.
+static uint32_t VerifyWhiteningKeystream(uint32_t randSeed)
+{
+    uint32_t rng = randSeed | 0x80000000;
+    uint32_t mismatches = 0;
+    std::vector<uint8_t> dataIn(3 + 1021);
+    std::vector<uint8_t> dataOut;
+    for (size_t i = 0; i < dataIn.size(); i++)
+    {
+        dataIn[i] = XorShift32(rng) & 0xFF;
+    }
 
-    LinearFeedbackShiftRegister lsfr;
-};
+    for (uint32_t clock = 0; clock < 128; clock += 2)
+    {
+        LinearFeedbackShiftRegister lsfr(7, 0x40 | ((clock >> 1) & 0x3F), LfsrEngine::Serial);
+        lsfr.AddGaloisPoly(0x91);
+        lsfr.AddGeneratorPoly(0x40);
+        lsfr.Shift(BluetoothWhitening::HEADER_SIZE_BITS);
+        std::vector<uint8_t> code = lsfr.GetDataOut(0);
+        lsfr.ClearDataOut(0, false);
+        lsfr.Shift(static_cast<uint32_t>((dataIn.size() - 3) * 8));
+        std::vector<uint8_t> payloadCode = lsfr.GetDataOut(0);
+        code.insert(code.end(), payloadCode.begin(), payloadCode.end());
 
-std::vector<std::string> unitTests =
-{
-    unitTestWhitening,
-    unitTestHec,
-    unitTestCrc,
-    unitTestFec23
-};
+        BluetoothWhitening whitening(clock);
+        whitening.WhitenData(dataIn, dataOut);
+        for (size_t i = 0; i < dataIn.size(); i++)
+        {
+            uint8_t expected = (dataIn[i] ^ code[i]) & (i == 2 ? 0x03 : 0xFF);
+            if (dataOut[i] != expected)
+            {
+                mismatches++;
+                break;
+            }
+        }
+    }
+    return mismatches;
+}
 
-void printhelp(const char* exeName)
+// Checks the table CRC against the bit serial LFSR for every UAP on pseudo
+// random payloads, returns the number of mismatches.
+static uint32_t VerifyCrc(uint32_t randSeed)
 {
-    printf("%s [BluetoothClk] [[testData] or [filename]]\n", exeName);
-    printf("BluetoothClk: only bits 1 - 6 inclusive are used\n");
-    printf("testData: space separated 2 digit hex bytes\n");
-    printf("filename: the file can be text with space separated 2 digit hex bytes, or binary. Detection is automatic.\n");
-    printf("Example: %s 60 10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09\n", exeName);
-    printf("Output: \n");
-//    printf("%s\n", exeName);
-}
+    uint32_t rng = randSeed | 0x80000000;
+    uint32_t mismatches = 0;
+    std::vector<uint8_t> payload;
 
-std::vector<uint8_t> testData;
-std::vector<uint8_t> expectedData;
-std::vector<uint8_t> dataOut;
-uint8_t seed = 0;
-uint32_t temp = 0;
-bool seedByteParsed = false;
-bool forcebinaryFile = false;
-bool crcMode = false;
-bool fecMode = false;
-bool hecMode = false;
-bool testResults = false;
-bool hopTest = false;
-int unitTestIndex = -1;
-int unitTestPassed = 0;
+    for (uint32_t uap = 0; uap < 256; uap++)
+    {
+        payload.resize(XorShift32(rng) % 400);
+        for (size_t i = 0; i < payload.size(); i++)
+        {
+            payload[i] = XorShift32(rng) & 0xFF;
+        }
+        BluetoothCrc crc(static_cast<uint8_t>(uap));
+        uint16_t crcVal = crc.CalcCrc(static_cast<uint8_t>(uap), payload.data(), payload.size());
+        mismatches += crcVal != BluetoothCrc::CalcCrcSerial(static_cast<uint8_t>(uap), payload) ? 1 : 0;
 
+        // long payloads through both kernels, the folding one needs at least 16 bytes
+        std::vector<uint8_t> longPayload(16 + XorShift32(rng) % 4000);
+        for (size_t i = 0; i < longPayload.size(); i++)
+        {
+            longPayload[i] = XorShift32(rng) & 0xFF;
+        }
+        const BluetoothCrc16& crc16 = BluetoothCrc16::Get();
+        uint16_t serialCrc = BluetoothCrc::CalcCrcSerial(static_cast<uint8_t>(uap), longPayload, LfsrEngine::ByteTable);
+        mismatches += crc16.Update(CrcKernel::Table, BluetoothCrc16::Seed(uap), longPayload.data(), longPayload.size()) != serialCrc ? 1 : 0;
+        mismatches += crc16.Update(CrcKernel::ClMul, BluetoothCrc16::Seed(uap), longPayload.data(), longPayload.size()) != serialCrc ? 1 : 0;
+
+        // a CRC continued over two calls matches one over the whole payload
+        size_t split = payload.size() / 3;
+        std::vector<uint8_t> first(payload.begin(), payload.begin() + split);
+        std::vector<uint8_t> second(payload.begin() + split, payload.end());
+        uint16_t continued = 0;
+        crc.CalcCrc(first, continued);
+        crc.CalcCrc(second, continued);
+        mismatches += crcVal != continued ? 1 : 0;
+    }
+    return mismatches;
+}
 
-static void parseData(const char* arg, std::vector<uint8_t>& data)
+// Checks the HEC tables and batch calls against the bit serial LFSR for every
+// UAP and header, returns the number of mismatches.
+static uint32_t VerifyHec()
 {
-    char* endPtr = nullptr;
+    uint32_t mismatches = 0;
+    std::vector<uint16_t> headers(BluetoothHecTable::HEADER_MASK + 1);
+    std::vector<uint8_t> uaps(headers.size());
+    std::vector<uint8_t> hecOneUap(headers.size());
+    std::vector<uint8_t> hecManyUaps(headers.size());
 
-    temp = strtol(arg, &endPtr, 16);
-    if (endPtr != arg)
+    for (uint32_t uap = 0; uap < 256; uap++)
     {
-        data.push_back(temp & 0xFF);
+        for (size_t header = 0; header < headers.size(); header++)
+        {
+            headers[header] = static_cast<uint16_t>(header);
+            uaps[header] = static_cast<uint8_t>(uap);
+        }
+        BluetoothHec hec(static_cast<uint8_t>(uap));
+        hec.CalcHec(headers.data(), headers.size(), hecOneUap.data());
+        hec.CalcHec(uaps.data(), headers.data(), headers.size(), hecManyUaps.data());
+        for (size_t header = 0; header < headers.size(); header++)
+        {
+            uint8_t expected = BluetoothHecTable::CalcSerial(static_cast<uint8_t>(uap), static_cast<uint16_t>(header), LfsrEngine::ByteTable);
+            mismatches += hecOneUap[header] != expected ? 1 : 0;
+            mismatches += hecManyUaps[header] != expected ? 1 : 0;
+        }
     }
-    else
+    return mismatches;
+}
+
+// parity table against the LFSR, every single bit error corrected, random
+// packed payloads through the batch encoder and decoder with one error per block
+static uint32_t VerifyFec23(uint32_t seed)
+{
+    const BluetoothFec23& fec = BluetoothFec23::Get();
+    uint32_t mismatches = 0;
+    for (uint32_t data = 0; data <= BluetoothFec23::DATA_MASK; data++)
     {
-        size_t bytesRead = 0;
-        if (forcebinaryFile == false)
+        mismatches += fec.CalcParity(static_cast<uint16_t>(data)) != BluetoothFec23::CalcParitySerial(static_cast<uint16_t>(data)) ? 1 : 0;
+        uint16_t block = fec.Encode(static_cast<uint16_t>(data));
+        for (uint32_t bit = 0; bit <= BluetoothFec23::BLOCK_BITS; bit++)
         {
-            FILE* dataFile = nullptr;
-            fopen_s(&dataFile, arg, "rt");
-            if (dataFile != nullptr)
-            {
-                int conversions = 1;
+            uint16_t errorBlock = bit < BluetoothFec23::BLOCK_BITS ? block ^ (1 << bit) : block;
+            uint16_t decoded = 0;
+            Fec23Status status = fec.Decode(errorBlock, decoded);
+            Fec23Status expected = bit < BluetoothFec23::BLOCK_BITS ? Fec23Status::Corrected : Fec23Status::Clean;
+            mismatches += status != expected || decoded != data ? 1 : 0;
+        }
+    }
 
-                while (conversions > 0 && feof(dataFile) == false)
-                {
-                    conversions = fscanf_s(dataFile, "%02X", &temp);
-                    if (conversions > 0)
-                    {
-                        data.push_back(temp & 0xFF);
-                        bytesRead++;
-                    }
-                    else
-                    {
-                        if (bytesRead == 0)
-                        {
-                            fclose(dataFile);
-                            break;
-                        }
-                    }
-                }
-            }
+    uint32_t random = seed | 1;
+    for (uint32_t run = 0; run < 64; run++)
+    {
+        size_t dataBits = 1 + XorShift32(random) % 2000;
+        std::vector<uint8_t> data((dataBits + 7) / 8);
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            data[i] = XorShift32(random) & 0xFF;
+        }
+        if (dataBits & 7)
+        {
+            data.back() &= (1 << (dataBits & 7)) - 1;
+        }
+        std::vector<uint8_t> encoded(BluetoothFec23::EncodedBytes(dataBits));
+        fec.Encode(data.data(), dataBits, encoded.data());
+        size_t blockCount = (dataBits + 9) / 10;
+        for (size_t block = 0; block < blockCount; block++)
+        {
+            size_t bit = block * BluetoothFec23::BLOCK_BITS + XorShift32(random) % BluetoothFec23::BLOCK_BITS;
+            encoded[bit / 8] ^= 1 << (bit & 7);
         }
+        std::vector<uint8_t> decoded((blockCount * 10 + 7) / 8);
+        size_t corrected = 0;
+        mismatches += fec.Decode(encoded.data(), blockCount, decoded.data(), &corrected) != 0 ? 1 : 0;
+        mismatches += corrected != blockCount ? 1 : 0;
+        decoded.resize(data.size());
+        mismatches += decoded != data ? 1 : 0;
+    }
+    return mismatches;
+}
 
-        if (bytesRead == 0)
+// batch and single header decode against a bit by bit vote
+static uint32_t VerifyFec13(uint32_t seed)
+{
+    uint32_t mismatches = 0;
+    uint32_t random = seed | 1;
+    const size_t counts[] = { 1, 2, 17, 200 };
+    for (size_t countIndex = 0; countIndex < sizeof(counts) / sizeof(counts[0]); countIndex++)
+    {
+        size_t count = counts[countIndex];
+        std::vector<uint8_t> coded(count * BluetoothFec13::CODED_BYTES);
+        for (size_t i = 0; i < coded.size(); i++)
         {
-            FILE* dataFile = nullptr;
-            fopen_s(&dataFile, arg, "rt");
-            if (dataFile != nullptr)
+            coded[i] = XorShift32(random) & 0xFF;
+        }
+        std::vector<uint8_t> headers(count * BluetoothFec13::HEADER_BYTES);
+        std::vector<uint32_t> unanimous(count);
+        size_t splitCount = BluetoothFec13::Decode(coded.data(), count, headers.data(), unanimous.data());
+
+        size_t expectedSplitCount = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t bits = BluetoothFec13::LoadCoded(&coded[i * BluetoothFec13::CODED_BYTES]);
+            uint32_t expectedHeader = 0;
+            uint32_t expectedUnanimous = 0;
+            for (uint32_t bit = 0; bit < BluetoothFec13::HEADER_BITS; bit++)
             {
-                fseek(dataFile, 0L, SEEK_END);
-                size_t length = ftell(dataFile);
-                fseek(dataFile, 0L, SEEK_SET);
-                size_t startIndex = data.size();
-                data.resize(startIndex + length);
-                fread(&data[startIndex], 1, length, dataFile);
+                uint32_t votes = ((bits >> (3 * bit)) & 1) + ((bits >> (3 * bit + 1)) & 1) + ((bits >> (3 * bit + 2)) & 1);
+                expectedHeader |= (votes >= 2 ? 1 : 0) << bit;
+                expectedUnanimous |= (votes == 0 || votes == 3 ? 1 : 0) << bit;
             }
+            expectedSplitCount += expectedUnanimous != BluetoothFec13::HEADER_MASK ? 1 : 0;
+
+            uint32_t scalarUnanimous = 0;
+            uint8_t scalarHeader[BluetoothFec13::HEADER_BYTES];
+            uint32_t scalarBits = BluetoothFec13::Decode(&coded[i * BluetoothFec13::CODED_BYTES], scalarHeader, scalarUnanimous);
+            const uint8_t* header = &headers[i * BluetoothFec13::HEADER_BYTES];
+            uint32_t batchBits = header[0] | header[1] << 8 | header[2] << 16;
+            mismatches += scalarBits != expectedHeader ? 1 : 0;
+            mismatches += scalarUnanimous != expectedUnanimous ? 1 : 0;
+            mismatches += batchBits != expectedHeader ? 1 : 0;
+            mismatches += unanimous[i] != expectedUnanimous ? 1 : 0;
         }
-
+        mismatches += splitCount != expectedSplitCount ? 1 : 0;
     }
+    return mismatches;
 }
 
-static void parseArgs(std::vector<std::string> args)
+static double BenchHec(bool useLfsr, uint32_t headerCount)
 {
-    testData.clear();
-    expectedData.clear();
-    dataOut.clear();
-    seed = 0;
-    temp = 0;
-    seedByteParsed = false;
-    forcebinaryFile = false;
-    crcMode = false;
-    fecMode = false;
-    hecMode = false;
-    testResults = false;
-    hopTest = false;
+    std::vector<uint16_t> headers(headerCount);
+    std::vector<uint8_t> hecOut(headerCount);
+    for (uint32_t i = 0; i < headerCount; i++)
+    {
+        headers[i] = static_cast<uint16_t>(i * 7) & BluetoothHecTable::HEADER_MASK;
+    }
 
-    for (size_t i = 1; i < args.size(); i++)
+    auto start = std::chrono::steady_clock::now();
+    if (useLfsr)
     {
-        char* endPtr = nullptr;
+        for (uint32_t i = 0; i < headerCount; i++)
+        {
+            hecOut[i] = BluetoothHecTable::CalcSerial(0x47, headers[i], LfsrEngine::WordParallel);
+        }
+    }
+    else
+    {
+        BluetoothHec hec(0x47);
+        hec.CalcHec(headers.data(), headerCount, hecOut.data());
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    volatile uint8_t sink = hecOut[headerCount / 2];
+    (void)sink;
+    return seconds > 0 ? headerCount / seconds / 1e6 : 0;
+}
 
-        if(args[i] == "--hop")
+static double BenchClockRecovery(bool knownUap, uint32_t headerCount)
+{
+    std::vector<uint8_t> headers(headerCount * 3);
+    uint32_t random = 0x12345678;
+    for (size_t i = 0; i < headers.size(); i++)
+    {
+        headers[i] = XorShift32(random) & 0xFF;
+    }
+
+    ClockRecovery recovery;
+    uint64_t check = 0;
+    uint8_t uaps[ClockRecovery::SEED_COUNT];
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < headerCount; i++)
+    {
+        if (knownUap)
+        {
+            check += recovery.ValidClocks(0x47, &headers[i * 3]);
+        }
+        else
+        {
+            recovery.CandidateUaps(&headers[i * 3], uaps);
+            check += uaps[i & (ClockRecovery::SEED_COUNT - 1)];
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    volatile uint64_t sink = check;
+    (void)sink;
+    return seconds > 0 ? headerCount / seconds / 1e6 : 0;
+}
+
+static double BenchFec13(bool batch, uint32_t headerCount)
+{
+    std::vector<uint8_t> coded(headerCount * BluetoothFec13::CODED_BYTES);
+    std::vector<uint8_t> headers(headerCount * BluetoothFec13::HEADER_BYTES);
+    uint32_t random = 0x2468ACE1;
+    for (size_t i = 0; i < coded.size(); i++)
+    {
+        coded[i] = XorShift32(random) & 0xFF;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (batch)
+    {
+        BluetoothFec13::Decode(coded.data(), headerCount, headers.data());
+    }
+    else
+    {
+        for (uint32_t i = 0; i < headerCount; i++)
+        {
+            uint32_t unanimous = 0;
+            BluetoothFec13::Decode(&coded[i * BluetoothFec13::CODED_BYTES], &headers[i * BluetoothFec13::HEADER_BYTES], unanimous);
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    volatile uint8_t sink = headers[headers.size() / 2];
+    (void)sink;
+    return seconds > 0 ? headerCount / seconds / 1e6 : 0;
+}
+
+// Builds the raw bits of a BR ACL packet the way a transmitter would, for
+// round trips through PacketDecoder. payload is the payload header and body
+// for types with a payload header, the FHS bits otherwise.
+static void EncodePacket(uint32_t lap, uint8_t uap, uint32_t clock, uint16_t header10, bool fec23, bool crc,
+    const std::vector<uint8_t>& payload, size_t leadingBits, std::vector<uint8_t>& bits, size_t& bitCount)
+{
+    std::vector<uint8_t> stream;
+    std::vector<uint8_t> data;
+    const BluetoothFec23& fec = BluetoothFec23::Get();
+    uint64_t syncWord = PacketDecoder::SyncWord(lap);
+    uint32_t header = header10 | BluetoothHecTable::Get().Calc(uap, header10) << 10;
+
+    for (size_t i = 0; i < leadingBits; i++)
+    {
+        stream.push_back(static_cast<uint8_t>(i * 7 / 3) & 1);
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        stream.push_back(((syncWord & 1) ^ i ^ 1) & 1);
+    }
+    for (uint32_t i = 0; i < 64; i++)
+    {
+        stream.push_back((syncWord >> i) & 1);
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        stream.push_back(((syncWord >> 63) ^ i ^ 1) & 1);
+    }
+
+    data.push_back(header & 0xFF);
+    data.push_back((header >> 8) & 0xFF);
+    data.push_back((header >> 16) & 0xFF);
+    data.insert(data.end(), payload.begin(), payload.end());
+    if (crc)
+    {
+        uint16_t crcVal = BluetoothCrc16::Get().Calc(uap, payload.data(), payload.size());
+        data.push_back(crcVal & 0xFF);
+        data.push_back(crcVal >> 8);
+    }
+    BluetoothWhitening whitening(clock);
+    whitening.WhitenData(data.data(), data.size());
+
+    for (uint32_t i = 0; i < BluetoothFec13::HEADER_BITS; i++)
+    {
+        uint8_t bit = (data[i / 8] >> (i & 7)) & 1;
+        stream.insert(stream.end(), 3, bit);
+    }
+    size_t payloadBits = (data.size() - 3) * 8;
+    if (fec23)
+    {
+        for (size_t block = 0; block * 10 < payloadBits; block++)
+        {
+            uint16_t blockData = 0;
+            for (uint32_t i = 0; i < 10 && block * 10 + i < payloadBits; i++)
+            {
+                size_t bit = block * 10 + i;
+                blockData |= ((data[3 + bit / 8] >> (bit & 7)) & 1) << i;
+            }
+            uint16_t coded = fec.Encode(blockData);
+            for (uint32_t i = 0; i < BluetoothFec23::BLOCK_BITS; i++)
+            {
+                stream.push_back((coded >> i) & 1);
+            }
+        }
+    }
+    else
+    {
+        for (size_t bit = 0; bit < payloadBits; bit++)
+        {
+            stream.push_back((data[3 + bit / 8] >> (bit & 7)) & 1);
+        }
+    }
+
+    bitCount = stream.size();
+    bits.assign((bitCount + 7) / 8, 0);
+    for (size_t i = 0; i < bitCount; i++)
+    {
+        bits[i / 8] |= stream[i] << (i & 7);
+    }
+}
+
+// random ACL packets of every supported type through one decoder, with a sync
+// bit error, a header copy error and one error per FEC 2/3 block
+static uint32_t VerifyPacketDecoder(uint32_t seed)
+{
+    const uint8_t types[] = { 0, 1, 2, 3, 4, 9, 10, 11, 14, 15 };
+    const uint16_t maxLengths[16] = { 0, 0, 0, 17, 27, 0, 0, 0, 0, 29, 121, 183, 0, 0, 224, 339 };
+    uint32_t random = seed | 1;
+    uint32_t mismatches = 0;
+    uint32_t lap = XorShift32(random) & 0xFFFFFF;
+    uint8_t uap = XorShift32(random) & 0xFF;
+    PacketDecoder decoder(lap, uap);
+    std::vector<uint8_t> bits;
+    std::vector<uint8_t> payload;
+
+    for (uint32_t run = 0; run < 200; run++)
+    {
+        uint8_t type = types[XorShift32(random) % sizeof(types)];
+        bool fec23 = type == 2 || type == 3 || type == 10 || type == 14;
+        bool crc = type != 0 && type != 1 && type != 9;
+        uint32_t clock = XorShift32(random) & 0x7F;
+        uint16_t header10 = static_cast<uint16_t>((XorShift32(random) & 0x387) | type << 3);
+        uint16_t length = 0;
+        payload.clear();
+        if (type == 2)
+        {
+            payload.resize(18);
+        }
+        else if (maxLengths[type] != 0)
+        {
+            length = static_cast<uint16_t>(XorShift32(random) % (maxLengths[type] + 1));
+            uint16_t payloadHeader = static_cast<uint16_t>((XorShift32(random) & 0x7) | length << 3);
+            payload.push_back(payloadHeader & 0xFF);
+            if (type >= 10)
+            {
+                payload.push_back(payloadHeader >> 8);
+            }
+            payload.resize(payload.size() + length);
+        }
+        size_t bodyOffset = type >= 10 ? 2 : (type == 2 ? 0 : 1);
+        for (size_t i = bodyOffset; i < payload.size(); i++)
+        {
+            payload[i] = XorShift32(random) & 0xFF;
+        }
+
+        size_t leadingBits = XorShift32(random) % 40;
+        size_t bitCount = 0;
+        EncodePacket(lap, uap, clock, header10, fec23, crc, payload, leadingBits, bits, bitCount);
+        size_t syncErrorBit = leadingBits + 4 + XorShift32(random) % 64;
+        bits[syncErrorBit / 8] ^= 1 << (syncErrorBit & 7);
+        size_t headerErrorBit = leadingBits + 72 + XorShift32(random) % BluetoothFec13::CODED_BITS;
+        bits[headerErrorBit / 8] ^= 1 << (headerErrorBit & 7);
+        size_t payloadStart = leadingBits + 72 + BluetoothFec13::CODED_BITS;
+        size_t blockCount = (payload.size() * 8 + (crc ? 16 : 0) + 9) / 10;
+        for (size_t block = 0; fec23 && block < blockCount; block++)
+        {
+            size_t bit = payloadStart + block * BluetoothFec23::BLOCK_BITS + XorShift32(random) % BluetoothFec23::BLOCK_BITS;
+            bits[bit / 8] ^= 1 << (bit & 7);
+        }
+
+        DecodedPacket packet;
+        bool valid = decoder.Decode(bits.data(), bitCount, clock, packet);
+        mismatches += valid == false ? 1 : 0;
+        mismatches += packet.syncOffset != leadingBits + 4 || packet.syncErrors != 1 ? 1 : 0;
+        mismatches += (packet.header & BluetoothHecTable::HEADER_MASK) != header10 || packet.type != type ? 1 : 0;
+        mismatches += packet.payloadComplete == false || packet.length != length ? 1 : 0;
+        mismatches += packet.fecCorrected != (fec23 ? blockCount : 0) || packet.fecUncorrectable != 0 ? 1 : 0;
+        mismatches += packet.payloadSize != payload.size() ? 1 : 0;
+        for (size_t i = 0; i < payload.size() && i < packet.payloadSize; i++)
+        {
+            mismatches += packet.payload[i] != payload[i] ? 1 : 0;
+        }
+
+        // a flipped payload bit of a non FEC packet must fail the CRC
+        if (crc && fec23 == false && payload.size() > bodyOffset)
+        {
+            size_t bit = payloadStart + bodyOffset * 8 + XorShift32(random) % ((payload.size() - bodyOffset) * 8);
+            bits[bit / 8] ^= 1 << (bit & 7);
+            mismatches += decoder.Decode(bits.data(), bitCount, clock, packet) || packet.crcValid ? 1 : 0;
+        }
+    }
+    return mismatches;
+}
+
+static double BenchPacketDecoder(uint8_t type, uint16_t length, uint32_t packetCount)
+{
+    uint32_t lap = 0x6C4F21;
+    uint8_t uap = 0x47;
+    bool fec23 = type == 3 || type == 10 || type == 14;
+    std::vector<uint8_t> payload;
+    uint16_t payloadHeader = static_cast<uint16_t>(2 | length << 3);
+    payload.push_back(payloadHeader & 0xFF);
+    if (type >= 10)
+    {
+        payload.push_back(payloadHeader >> 8);
+    }
+    payload.resize(payload.size() + length, 0x5A);
+    std::vector<uint8_t> bits;
+    size_t bitCount = 0;
+    EncodePacket(lap, uap, 0x60, static_cast<uint16_t>(1 | type << 3), fec23, true, payload, 13, bits, bitCount);
+
+    PacketDecoder decoder(lap, uap);
+    DecodedPacket packet;
+    uint32_t validCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < packetCount; i++)
+    {
+        validCount += decoder.Decode(bits.data(), bitCount, 0x60, packet) ? 1 : 0;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    volatile uint32_t sink = validCount;
+    (void)sink;
+    return seconds > 0 ? packetCount / seconds / 1e6 : 0;
+}
+
+// Per worker state of a batch run, nothing in here is shared between threads.
+struct BatchWorker
+{
+    BatchWorker(uint32_t lap, uint8_t uap)
+        :decoder(lap, uap)
+    {
+    }
+
+    PacketDecoder decoder;
+    DecodedPacket packet;
+    std::vector<uint8_t> packetOut;
+};
+
+// Dewhitens a record in the WhitenData layout or, with a LAP, decodes it as
+// raw packet bits to the header, a sync, HEC and CRC flags byte and the
+// payload body. The output record keeps the clock of the input record.
+static void ProcessBatchRecord(BatchWorker& worker, bool decodePackets, const BatchRecord& record, std::vector<uint8_t>& out)
+{
+    if (decodePackets == false)
+    {
+        size_t start = out.size();
+        AppendBatchRecord(out, record.clock, record.data, record.size);
+        BluetoothWhitening whitening(record.clock);
+        whitening.WhitenData(out.data() + start + BATCH_RECORD_HEADER_SIZE, record.size);
+        return;
+    }
+    DecodedPacket& packet = worker.packet;
+    worker.decoder.Decode(record.data, record.size * 8, record.clock, packet);
+    worker.packetOut.clear();
+    for (uint32_t i = 0; i < BluetoothFec13::HEADER_BYTES; i++)
+    {
+        worker.packetOut.push_back((packet.header >> (8 * i)) & 0xFF);
+    }
+    worker.packetOut.push_back((packet.syncFound ? 1 : 0) | (packet.hecValid ? 2 : 0) | (packet.crcValid ? 4 : 0));
+    if (packet.payloadComplete)
+    {
+        worker.packetOut.insert(worker.packetOut.end(), packet.payload + packet.bodyOffset, packet.payload + packet.payloadSize);
+    }
+    AppendBatchRecord(out, record.clock, worker.packetOut.data(), worker.packetOut.size());
+}
+
+static void RunBatch(BatchProcessor& batch, const std::vector<BatchRecord>& records, bool decodePackets, uint32_t lap, uint8_t uap, std::vector<uint8_t>& output)
+{
+    batch.Run(records, output,
+        [lap, uap]() { return BatchWorker(lap, uap); },
+        [decodePackets](BatchWorker& worker, const BatchRecord& record, std::vector<uint8_t>& out)
+        {
+            ProcessBatchRecord(worker, decodePackets, record, out);
+        });
+}
+
+// Records from input to output one at a time, as RunBatch would process
+// them, in memory bounded by the stream buffers whatever the input length.
+// Returns false when the input ended inside a record.
+static bool RunStream(FILE* input, FILE* output, bool hexText, bool decodePackets, uint32_t lap, uint8_t uap, size_t bufferSize, size_t& recordCount)
+{
+    RecordStream stream(input, bufferSize);
+    RecordWriter writer(output, hexText, bufferSize);
+    BatchWorker worker(lap, uap);
+    std::vector<uint8_t> recordOut;
+    recordOut.reserve(RecordStream::MAX_RECORD_SIZE);
+    recordCount = 0;
+    bool complete = stream.Run([&](const BatchRecord& record)
+        {
+            recordOut.clear();
+            ProcessBatchRecord(worker, decodePackets, record, recordOut);
+            writer.Write(recordOut.data(), recordOut.size());
+            recordCount++;
+        },
+        [&]()
+        {
+            // no input waiting, hand what is done to the next stage of the pipe
+            writer.Flush();
+        });
+    writer.Flush();
+    return complete;
+}
+
+struct PcapStats
+{
+    size_t packets = 0;
+    size_t bredrPackets = 0;
+    size_t clocksRecovered = 0;
+    size_t hecValid = 0;
+    size_t crcValid = 0;
+};
+
+// Dewhitens, HEC and CRC checks one LINKTYPE_BLUETOOTH_BREDR_BB packet in
+// place and describes the outcome in comment. The pseudo header carries no
+// Bluetooth clock, so a whitened packet gets clock bits 1 - 6 from the seeds
+// that give its header a valid HEC, the payload CRC picking between several.
+// uapKnown false takes the UAP from the reference UAP, when valid. The HEC
+// and CRC flags are replaced, every other flag is kept.
+static void AnnotateBredrPacket(const ClockRecovery& clockRecovery, bool uapKnown, uint8_t uap, std::vector<uint8_t>& packet, std::vector<uint8_t>& scratch, PcapStats& stats, std::string& comment)
+{
+    char text[80];
+    BredrBbHeader header;
+    if (header.Parse(packet.data(), packet.size()) == false)
+    {
+        comment = "short pseudo header";
+        return;
+    }
+    uint8_t* payload = packet.data() + BredrBbHeader::SIZE;
+    const size_t payloadSize = packet.size() - BredrBbHeader::SIZE;
+    if (uapKnown == false && (header.flags & BredrBbHeader::REFERENCE_UAP_VALID) != 0)
+    {
+        uapKnown = true;
+        uap = header.referenceUap;
+    }
+    if (uapKnown == false)
+    {
+        comment = "uap unknown";
+        return;
+    }
+
+    int32_t clock = -1;
+    if ((header.flags & BredrBbHeader::DEWHITENED) == 0)
+    {
+        uint8_t whitenedHeader[BluetoothFec13::HEADER_BYTES];
+        for (uint32_t i = 0; i < BluetoothFec13::HEADER_BYTES; i++)
+        {
+            whitenedHeader[i] = (header.packetHeader >> (8 * i)) & 0xFF;
+        }
+        const uint64_t clocks = clockRecovery.ValidClocks(uap, whitenedHeader);
+        uint32_t candidates = 0;
+        int32_t onlyClock = -1;
+        scratch.resize(payloadSize);
+        for (uint32_t clk6 = 0; clk6 < ClockRecovery::SEED_COUNT && clock < 0; clk6++)
+        {
+            if (((clocks >> clk6) & 1) == 0)
+            {
+                continue;
+            }
+            candidates++;
+            onlyClock = static_cast<int32_t>(clk6 << 1);
+            uint8_t headerBytes[BluetoothFec13::HEADER_BYTES];
+            BluetoothWhitening whitening(clk6 << 1);
+            whitening.WhitenData(whitenedHeader, sizeof(headerBytes), headerBytes, sizeof(headerBytes));
+            if (PacketDecoder::TypeHasCrc((headerBytes[0] >> 3) & 0xF) && payloadSize >= 2)
+            {
+                whitening.WhitenPayload(payload, scratch.data(), payloadSize);
+                uint16_t crcReceived = scratch[payloadSize - 2] | scratch[payloadSize - 1] << 8;
+                if (BluetoothCrc16::Get().Calc(uap, scratch.data(), payloadSize - 2) == crcReceived)
+                {
+                    clock = static_cast<int32_t>(clk6 << 1);
+                }
+            }
+        }
+        if (clock < 0 && candidates == 1)
+        {
+            clock = onlyClock;
+        }
+        if (clock < 0)
+        {
+            snprintf(text, sizeof(text), "uap %02X clock not found, %u candidates", uap, candidates);
+            comment = text;
+            return;
+        }
+
+        uint8_t headerBytes[BluetoothFec13::HEADER_BYTES];
+        BluetoothWhitening whitening(static_cast<uint32_t>(clock));
+        whitening.WhitenData(whitenedHeader, sizeof(headerBytes), headerBytes, sizeof(headerBytes));
+        whitening.WhitenPayload(payload, payload, payloadSize);
+        header.packetHeader = headerBytes[0] | headerBytes[1] << 8 | headerBytes[2] << 16;
+        header.flags |= BredrBbHeader::DEWHITENED;
+        stats.clocksRecovered++;
+    }
+
+    const uint32_t packetHeader = header.packetHeader;
+    const bool hecValid = BluetoothHecTable::Get().Calc(uap, packetHeader & BluetoothHecTable::HEADER_MASK) == ((packetHeader >> 10) & 0xFF);
+    stats.hecValid += hecValid ? 1 : 0;
+    const char* crcText = "none";
+    header.flags &= ~(BredrBbHeader::HEC_CHECKED | BredrBbHeader::HEC_VALID | BredrBbHeader::CRC_CHECKED | BredrBbHeader::CRC_VALID);
+    header.flags |= BredrBbHeader::HEC_CHECKED | (hecValid ? BredrBbHeader::HEC_VALID : 0);
+    if (PacketDecoder::TypeHasCrc((packetHeader >> 3) & 0xF) && payloadSize >= 2)
+    {
+        uint16_t crcReceived = payload[payloadSize - 2] | payload[payloadSize - 1] << 8;
+        bool crcValid = BluetoothCrc16::Get().Calc(uap, payload, payloadSize - 2) == crcReceived;
+        header.flags |= BredrBbHeader::CRC_CHECKED | (crcValid ? BredrBbHeader::CRC_VALID : 0);
+        stats.crcValid += crcValid ? 1 : 0;
+        crcText = crcValid ? "ok" : "bad";
+    }
+    header.Write(packet.data());
+
+    char clockText[8] = "given";
+    if (clock >= 0)
+    {
+        snprintf(clockText, sizeof(clockText), "%02X", static_cast<uint8_t>(clock));
+    }
+    snprintf(text, sizeof(text), "uap %02X clk %s hec %s crc %s", uap, clockText, hecValid ? "ok" : "bad", crcText);
+    comment = text;
+}
+
+// pcap or pcapng in, one packet at a time, annotated pcapng out. Packets of
+// other link types are copied through. Returns false when the input is not a
+// capture or is damaged, the packets before the damage are still written.
+static bool RunPcap(FILE* input, FILE* output, bool uapKnown, uint8_t uap, PcapStats& stats)
+{
+    PcapReader reader(input);
+    if (reader.Open() == false)
+    {
+        return false;
+    }
+    PcapngWriter writer(output);
+    const ClockRecovery clockRecovery;
+    // output interface per link type
+    std::vector<std::pair<uint32_t, uint32_t>> interfaces;
+    std::vector<uint8_t> packetData;
+    std::vector<uint8_t> scratch;
+    std::string comment;
+    PcapPacket packet;
+    while (reader.Next(packet))
+    {
+        uint32_t interfaceId = 0;
+        size_t interfaceIndex = 0;
+        for (; interfaceIndex < interfaces.size() && interfaces[interfaceIndex].first != packet.linkType; interfaceIndex++)
+        {
+        }
+        if (interfaceIndex == interfaces.size())
+        {
+            interfaces.push_back(std::make_pair(packet.linkType, writer.AddInterface(packet.linkType)));
+        }
+        interfaceId = interfaces[interfaceIndex].second;
+
+        stats.packets++;
+        packetData.assign(packet.data, packet.data + packet.size);
+        comment.clear();
+        if (packet.linkType == LINKTYPE_BLUETOOTH_BREDR_BB)
+        {
+            stats.bredrPackets++;
+            AnnotateBredrPacket(clockRecovery, uapKnown, uap, packetData, scratch, stats, comment);
+        }
+        writer.WritePacket(interfaceId, packet.timestampNs, packetData.data(), packetData.size(), packet.originalSize, comment);
+    }
+    writer.Flush();
+    return reader.Malformed() == false;
+}
+
+// A new empty file with a unique name in the temp directory, open for
+// writing, and its path. nullptr when none can be made.
+static FILE* CreateTempFile(std::string& path)
+{
+#ifdef _WIN32
+    char directory[MAX_PATH];
+    char name[MAX_PATH];
+    DWORD length = GetTempPathA(MAX_PATH, directory);
+    if (length == 0 || length > MAX_PATH || GetTempFileNameA(directory, "btw", 0, name) == 0)
+    {
+        return nullptr;
+    }
+    path = name;
+    FILE* file = nullptr;
+    fopen_s(&file, name, "wb");
+    if (file == nullptr)
+    {
+        remove(name);
+    }
+    return file;
+#else
+    const char* directory = getenv("TMPDIR");
+    path = directory != nullptr && directory[0] != 0 ? directory : "/tmp";
+    path += "/btwhite_XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back(0);
+    int descriptor = mkstemp(name.data());
+    if (descriptor < 0)
+    {
+        return nullptr;
+    }
+    path = name.data();
+    FILE* file = fdopen(descriptor, "wb");
+    if (file == nullptr)
+    {
+        close(descriptor);
+        remove(path.c_str());
+    }
+    return file;
+#endif
+}
+
+// random whitening and packet captures through 1 and several threads with
+// small chunks so workers steal, against a plain single threaded loop
+static uint32_t VerifyBatch(uint32_t seed)
+{
+    uint32_t random = seed | 1;
+    uint32_t mismatches = 0;
+    const uint32_t lap = 0x6C4F21;
+    const uint8_t uap = 0x47;
+    std::vector<uint8_t> capture;
+    std::vector<uint8_t> packetCapture;
+    std::vector<uint8_t> expected;
+    std::vector<uint8_t> packetBits;
+    std::vector<uint8_t> payload;
+
+    for (uint32_t record = 0; record < 5000; record++)
+    {
+        std::vector<uint8_t> data(XorShift32(random) % 400);
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            data[i] = XorShift32(random) & 0xFF;
+        }
+        uint32_t clock = XorShift32(random);
+        AppendBatchRecord(capture, clock, data.data(), data.size());
+        BluetoothWhitening whitening(clock);
+        whitening.WhitenData(data.data(), data.size());
+        AppendBatchRecord(expected, clock, data.data(), data.size());
+    }
+
+    for (uint32_t record = 0; record < 500; record++)
+    {
+        uint16_t length = static_cast<uint16_t>(XorShift32(random) % 28);
+        payload.assign(1, static_cast<uint8_t>(2 | length << 3));
+        for (uint32_t i = 0; i < length; i++)
+        {
+            payload.push_back(XorShift32(random) & 0xFF);
+        }
+        uint32_t clock = XorShift32(random) & 0x7F;
+        size_t bitCount = 0;
+        EncodePacket(lap, uap, clock, static_cast<uint16_t>(1 | 4 << 3), false, true, payload, XorShift32(random) % 16, packetBits, bitCount);
+        AppendBatchRecord(packetCapture, clock, packetBits.data(), packetBits.size());
+    }
+
+    std::vector<BatchRecord> records;
+    std::vector<BatchRecord> packetRecords;
+    mismatches += ParseBatchRecords(capture.data(), capture.size(), records) ? 0 : 1;
+    mismatches += ParseBatchRecords(packetCapture.data(), packetCapture.size(), packetRecords) ? 0 : 1;
+    mismatches += ParseBatchRecords(capture.data(), capture.size() - 1, records) ? 1 : 0;
+    ParseBatchRecords(capture.data(), capture.size(), records);
+
+    std::vector<uint8_t> packetSingle;
+    BatchProcessor single(1);
+    RunBatch(single, packetRecords, true, lap, uap, packetSingle);
+    std::vector<BatchRecord> decodedRecords;
+    mismatches += ParseBatchRecords(packetSingle.data(), packetSingle.size(), decodedRecords) ? 0 : 1;
+    for (size_t i = 0; i < decodedRecords.size(); i++)
+    {
+        // sync, HEC and CRC all valid
+        mismatches += decodedRecords[i].size < 4 || decodedRecords[i].data[3] != 7 ? 1 : 0;
+    }
+
+    // the same capture mapped from a file of its own in the temp directory,
+    // skipped when no temp file can be made
+    std::string mappedPath;
+    FILE* mappedFile = CreateTempFile(mappedPath);
+    if (mappedFile != nullptr)
+    {
+        bool written = fwrite(capture.data(), 1, capture.size(), mappedFile) == capture.size();
+        written = fclose(mappedFile) == 0 && written;
+        MappedFile mapping;
+        bool opened = written && mapping.Open(mappedPath.c_str());
+#ifndef _WIN32
+        // the mapping keeps the data, nothing is left behind whatever follows
+        remove(mappedPath.c_str());
+#endif
+        std::vector<BatchRecord> mappedRecords;
+        mismatches += opened && mapping.Size() == capture.size() ? 0 : 1;
+        mismatches += ParseBatchRecords(mapping.Data(), mapping.Size(), mappedRecords) ? 0 : 1;
+        std::vector<uint8_t> output;
+        BatchProcessor batch(2);
+        RunBatch(batch, mappedRecords, false, lap, uap, output);
+        mismatches += output != expected ? 1 : 0;
+        mapping.Close();
+#ifdef _WIN32
+        remove(mappedPath.c_str());
+#endif
+    }
+
+    const uint32_t threadCounts[] = { 1, 3, 8 };
+    const size_t chunkSizes[] = { 1, 7, 256 };
+    for (uint32_t threadIndex = 0; threadIndex < 3; threadIndex++)
+    {
+        for (uint32_t chunkIndex = 0; chunkIndex < 3; chunkIndex++)
+        {
+            BatchProcessor batch(threadCounts[threadIndex], chunkSizes[chunkIndex]);
+            std::vector<uint8_t> output;
+            RunBatch(batch, records, false, lap, uap, output);
+            mismatches += output != expected ? 1 : 0;
+            RunBatch(batch, packetRecords, true, lap, uap, output);
+            mismatches += output != packetSingle ? 1 : 0;
+        }
+    }
+    return mismatches;
+}
+
+// captures through RunStream with buffers from one byte up, so records split
+// across any number of buffers, against RunBatch, raw and as hex text, then
+// records trickling through a pipe, each result due before the next record
+static uint32_t VerifyStream(uint32_t seed)
+{
+    uint32_t random = seed | 1;
+    uint32_t mismatches = 0;
+    const uint32_t lap = 0x6C4F21;
+    const uint8_t uap = 0x47;
+    std::vector<uint8_t> capture;
+    std::vector<uint8_t> packetCapture;
+    std::vector<uint8_t> packetBits;
+    std::vector<uint8_t> payload;
+
+    for (uint32_t record = 0; record < 300; record++)
+    {
+        // empty records and one of the largest length
+        size_t size = record == 7 ? 0xFFFF : (record % 50 == 3 ? 0 : XorShift32(random) % 400);
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            data[i] = XorShift32(random) & 0xFF;
+        }
+        AppendBatchRecord(capture, XorShift32(random), data.data(), data.size());
+    }
+    for (uint32_t record = 0; record < 100; record++)
+    {
+        uint16_t length = static_cast<uint16_t>(XorShift32(random) % 28);
+        payload.assign(1, static_cast<uint8_t>(2 | length << 3));
+        for (uint32_t i = 0; i < length; i++)
+        {
+            payload.push_back(XorShift32(random) & 0xFF);
+        }
+        uint32_t clock = XorShift32(random) & 0x7F;
+        size_t bitCount = 0;
+        EncodePacket(lap, uap, clock, static_cast<uint16_t>(1 | 4 << 3), false, true, payload, XorShift32(random) % 16, packetBits, bitCount);
+        AppendBatchRecord(packetCapture, clock, packetBits.data(), packetBits.size());
+    }
+
+    const size_t bufferSizes[] = { 1, 5, 4093, RecordStream::DEFAULT_BUFFER_SIZE };
+    for (uint32_t run = 0; run < 4 * 2 * 2 + 1; run++)
+    {
+        const size_t bufferSize = bufferSizes[(run / 4) % 4];
+        const bool decodePackets = (run & 1) != 0;
+        const bool hexText = (run & 2) != 0;
+        // the last run cuts the capture short inside its final record
+        const bool truncated = run == 4 * 2 * 2;
+        const std::vector<uint8_t>& input = decodePackets ? packetCapture : capture;
+        const size_t inputSize = truncated ? input.size() - 1 : input.size();
+
+        std::vector<BatchRecord> records;
+        ParseBatchRecords(input.data(), inputSize, records);
+        std::vector<uint8_t> expected;
+        BatchProcessor single(1);
+        RunBatch(single, records, decodePackets, lap, uap, expected);
+
+        FILE* inFile = tmpfile();
+        FILE* outFile = tmpfile();
+        if (inFile == nullptr || outFile == nullptr)
+        {
+            mismatches++;
+            if (inFile != nullptr) fclose(inFile);
+            if (outFile != nullptr) fclose(outFile);
+            continue;
+        }
+        fwrite(input.data(), 1, inputSize, inFile);
+        rewind(inFile);
+        size_t recordCount = 0;
+        bool complete = RunStream(inFile, outFile, hexText, decodePackets, lap, uap, bufferSize, recordCount);
+        mismatches += complete == truncated ? 1 : 0;
+        mismatches += recordCount != records.size() ? 1 : 0;
+
+        std::vector<uint8_t> output;
+        long outputSize = ftell(outFile);
+        output.resize(outputSize > 0 ? outputSize : 0);
+        rewind(outFile);
+        mismatches += fread(output.data(), 1, output.size(), outFile) != output.size() ? 1 : 0;
+        fclose(inFile);
+        fclose(outFile);
+
+        if (hexText)
+        {
+            size_t lines = 0;
+            for (size_t i = 0; i < output.size(); i++)
+            {
+                lines += output[i] == '\n' ? 1 : 0;
+            }
+            mismatches += lines != records.size() ? 1 : 0;
+            std::vector<uint8_t> parsed;
+            HexParser::Parse(reinterpret_cast<const char*>(output.data()), output.size(), parsed);
+            output.swap(parsed);
+        }
+        mismatches += output != expected ? 1 : 0;
+    }
+
+#ifndef _WIN32
+    // a live source: records go into a pipe a few bytes at a time, and each
+    // record's hex line has to come out of the output pipe before the next
+    // record is written, with the input still open
+    int inPipe[2];
+    int outPipe[2];
+    if (pipe(inPipe) != 0)
+    {
+        return mismatches + 1;
+    }
+    if (pipe(outPipe) != 0)
+    {
+        close(inPipe[0]);
+        close(inPipe[1]);
+        return mismatches + 1;
+    }
+    FILE* streamIn = fdopen(inPipe[0], "rb");
+    FILE* streamOut = fdopen(outPipe[1], "wb");
+    size_t liveCount = 0;
+    bool liveComplete = false;
+    std::thread streamThread([&]()
+        {
+            liveComplete = RunStream(streamIn, streamOut, true, false, lap, uap, RecordStream::DEFAULT_BUFFER_SIZE, liveCount);
+            fclose(streamOut);
+        });
+
+    std::vector<BatchRecord> records;
+    ParseBatchRecords(capture.data(), capture.size(), records);
+    const size_t liveRecords = 7;
+    const size_t pieceSizes[] = { 1, 2, 3, 5 };
+    size_t piece = 0;
+    for (size_t record = 0; record < liveRecords; record++)
+    {
+        std::vector<uint8_t> raw;
+        AppendBatchRecord(raw, records[record].clock, records[record].data, records[record].size);
+        std::vector<BatchRecord> single;
+        ParseBatchRecords(raw.data(), raw.size(), single);
+        std::vector<uint8_t> processed;
+        BatchProcessor one(1);
+        RunBatch(one, single, false, lap, uap, processed);
+        std::string line;
+        for (size_t i = 0; i < processed.size(); i++)
+        {
+            char text[4];
+            snprintf(text, sizeof(text), "%02X ", processed[i]);
+            line += text;
+        }
+        line += '\n';
+
+        for (size_t offset = 0; offset < raw.size(); piece++)
+        {
+            size_t size = pieceSizes[piece % 4] < raw.size() - offset ? pieceSizes[piece % 4] : raw.size() - offset;
+            mismatches += write(inPipe[1], raw.data() + offset, size) != static_cast<ssize_t>(size) ? 1 : 0;
+            offset += size;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        std::string received;
+        while (received.size() < line.size())
+        {
+            pollfd ready = { outPipe[0], POLLIN, 0 };
+            if (poll(&ready, 1, 2000) <= 0)
+            {
+                break;
+            }
+            char text[4096];
+            ssize_t bytesRead = read(outPipe[0], text, sizeof(text));
+            if (bytesRead <= 0)
+            {
+                break;
+            }
+            received.append(text, bytesRead);
+        }
+        mismatches += received != line ? 1 : 0;
+    }
+    close(inPipe[1]);
+    streamThread.join();
+    fclose(streamIn);
+    char rest;
+    mismatches += read(outPipe[0], &rest, 1) != 0 ? 1 : 0;
+    close(outPipe[0]);
+    mismatches += liveComplete == false || liveCount != liveRecords ? 1 : 0;
+#endif
+    return mismatches;
+}
+
+// Whitened BR baseband packets at random clocks, some already dewhitened, one
+// with a broken CRC and one of another link type, through RunPcap from pcap in
+// both byte orders and from pcapng, then read back and checked against the
+// packets before whitening.
+static uint32_t VerifyPcap(uint32_t seed)
+{
+    uint32_t random = seed | 1;
+    uint32_t mismatches = 0;
+    const uint8_t uap = 0x47;
+    const uint8_t types[] = { 0, 4, 11, 15, 3, 14 };
+    const ClockRecovery clockRecovery;
+
+    struct TestPacket
+    {
+        uint64_t timestampNs;
+        uint32_t linkType;
+        // as captured and as the annotated output should carry it
+        std::vector<uint8_t> captured;
+        std::vector<uint8_t> expected;
+        // the output flags as the LINKTYPE_BLUETOOTH_BREDR_BB layout numbers
+        // them, spelled out so a wrong BredrBbHeader constant shows
+        uint16_t expectedFlags;
+    };
+    std::vector<TestPacket> packets;
+    for (uint32_t index = 0; index < 200; index++)
+    {
+        TestPacket test;
+        // whole microseconds, so pcap keeps them exactly
+        test.timestampNs = (static_cast<uint64_t>(index) * 1250 + (XorShift32(random) & 0xFF)) * 1000;
+        test.linkType = LINKTYPE_BLUETOOTH_BREDR_BB;
+        const uint32_t clock = XorShift32(random) & 0x7E;
+        const uint8_t type = types[XorShift32(random) % sizeof(types)];
+        const bool alreadyDewhitened = index % 7 == 3;
+        const bool brokenCrc = index == 10;
+        // a reference LAP without a UAP leaves the packet as captured
+        const bool uapValid = index % 11 != 5;
+        const bool aliased = index % 5 == 2;
+
+        uint16_t header10 = static_cast<uint16_t>((XorShift32(random) & 0x7) | type << 3 | (XorShift32(random) & 0x7) << 7);
+        uint32_t header18 = header10 | BluetoothHecTable::Get().Calc(uap, header10) << 10;
+        std::vector<uint8_t> plain = { static_cast<uint8_t>(header18 & 0xFF), static_cast<uint8_t>((header18 >> 8) & 0xFF), static_cast<uint8_t>(header18 >> 16) };
+        if (type != 0)
+        {
+            uint16_t length = static_cast<uint16_t>(XorShift32(random) % (type == 4 || type == 3 ? 17 : 121));
+            plain.push_back(static_cast<uint8_t>(2 | (length << 3)));
+            if (type != 4 && type != 3)
+            {
+                plain.push_back(static_cast<uint8_t>(length >> 5));
+            }
+            for (uint32_t i = 0; i < length; i++)
+            {
+                plain.push_back(XorShift32(random) & 0xFF);
+            }
+            uint16_t crc = BluetoothCrc16::Get().Calc(uap, plain.data() + 3, plain.size() - 3);
+            plain.push_back(crc & 0xFF);
+            plain.push_back(static_cast<uint8_t>(crc >> 8));
+            if (brokenCrc)
+            {
+                plain[4] ^= 0x10;
+            }
+        }
+        std::vector<uint8_t> whitened = plain;
+        BluetoothWhitening whitening(clock);
+        whitening.WhitenData(whitened.data(), whitened.size());
+
+        BredrBbHeader header = BredrBbHeader();
+        header.rfChannel = static_cast<uint8_t>(index % 79);
+        header.lap = 0x6C4F21;
+        header.referenceLap = 0x6C4F21;
+        header.referenceUap = uap;
+        header.flags = BredrBbHeader::REFERENCE_LAP_VALID | (uapValid ? BredrBbHeader::REFERENCE_UAP_VALID : 0) |
+            (aliased ? BredrBbHeader::CHANNEL_ALIASED : 0) | (alreadyDewhitened ? BredrBbHeader::DEWHITENED : 0);
+        const std::vector<uint8_t>& captured = alreadyDewhitened ? plain : whitened;
+        header.packetHeader = captured[0] | captured[1] << 8 | captured[2] << 16;
+        test.captured.resize(BredrBbHeader::SIZE);
+        header.Write(test.captured.data());
+        test.captured.insert(test.captured.end(), captured.begin() + 3, captured.end());
+
+        // a whitened packet without a CRC is only dewhitened when one clock fits its HEC
+        uint64_t clocks = clockRecovery.ValidClocks(uap, whitened.data());
+        bool clockFound = uapValid && (alreadyDewhitened || PacketDecoder::TypeHasCrc(type) || (clocks & (clocks - 1)) == 0);
+        const std::vector<uint8_t>& expected = clockFound ? plain : captured;
+        test.expectedFlags = static_cast<uint16_t>(0x0010 | (uapValid ? 0x0080 : 0) | (aliased ? 0x0040 : 0) | (alreadyDewhitened ? 0x0001 : 0));
+        if (clockFound)
+        {
+            // dewhitened, HEC checked and valid, CRC checked and valid unless broken
+            test.expectedFlags |= 0x0001 | 0x0100 | 0x0200;
+            test.expectedFlags |= PacketDecoder::TypeHasCrc(type) ? 0x0400 | (brokenCrc ? 0 : 0x0800) : 0;
+        }
+        header.flags = test.expectedFlags;
+        header.packetHeader = expected[0] | expected[1] << 8 | expected[2] << 16;
+        test.expected.resize(BredrBbHeader::SIZE);
+        header.Write(test.expected.data());
+        test.expected.insert(test.expected.end(), expected.begin() + 3, expected.end());
+        packets.push_back(test);
+    }
+    // passed through untouched
+    TestPacket other;
+    other.timestampNs = 5000000000ULL;
+    other.linkType = 1;
+    other.captured.assign(60, 0xA5);
+    other.expected = other.captured;
+    other.expectedFlags = 0xA5A5;
+    packets.push_back(other);
+    // a short BR packet is left as it is
+    TestPacket shortPacket;
+    shortPacket.timestampNs = 6000000000ULL;
+    shortPacket.linkType = LINKTYPE_BLUETOOTH_BREDR_BB;
+    shortPacket.captured.assign(BredrBbHeader::SIZE - 1, 0x11);
+    shortPacket.expected = shortPacket.captured;
+    shortPacket.expectedFlags = 0;
+    packets.push_back(shortPacket);
+
+    for (uint32_t format = 0; format < 3; format++)
+    {
+        FILE* inFile = tmpfile();
+        FILE* outFile = tmpfile();
+        if (inFile == nullptr || outFile == nullptr)
+        {
+            mismatches++;
+            if (inFile != nullptr) fclose(inFile);
+            if (outFile != nullptr) fclose(outFile);
+            continue;
+        }
+
+        if (format == 2)
+        {
+            PcapngWriter writer(inFile);
+            uint32_t bredr = writer.AddInterface(LINKTYPE_BLUETOOTH_BREDR_BB);
+            uint32_t ethernet = writer.AddInterface(1);
+            for (size_t i = 0; i < packets.size(); i++)
+            {
+                const TestPacket& test = packets[i];
+                writer.WritePacket(test.linkType == 1 ? ethernet : bredr, test.timestampNs, test.captured.data(), test.captured.size(), test.captured.size());
+            }
+        }
+        else
+        {
+            // pcap low byte first in microseconds, then high byte first in
+            // nanoseconds, one link type per file
+            const bool bigEndian = format == 1;
+            auto put32 = [inFile, bigEndian](uint32_t value)
+            {
+                uint8_t bytes[4];
+                for (uint32_t i = 0; i < 4; i++)
+                {
+                    bytes[bigEndian ? 3 - i : i] = static_cast<uint8_t>((value >> (8 * i)) & 0xFF);
+                }
+                fwrite(bytes, 1, 4, inFile);
+            };
+            put32(bigEndian ? 0xA1B23C4D : 0xA1B2C3D4);
+            put32(2 | 4 << 16);
+            put32(0);
+            put32(0);
+            put32(65535);
+            put32(LINKTYPE_BLUETOOTH_BREDR_BB);
+            for (size_t i = 0; i < packets.size(); i++)
+            {
+                const TestPacket& test = packets[i];
+                if (test.linkType != LINKTYPE_BLUETOOTH_BREDR_BB)
+                {
+                    continue;
+                }
+                put32(static_cast<uint32_t>(test.timestampNs / 1000000000));
+                put32(static_cast<uint32_t>(test.timestampNs % 1000000000 / (bigEndian ? 1 : 1000)));
+                put32(static_cast<uint32_t>(test.captured.size()));
+                put32(static_cast<uint32_t>(test.captured.size()));
+                fwrite(test.captured.data(), 1, test.captured.size(), inFile);
+            }
+        }
+        rewind(inFile);
+        PcapStats stats;
+        mismatches += RunPcap(inFile, outFile, false, 0, stats) ? 0 : 1;
+        rewind(outFile);
+
+        PcapReader reader(outFile);
+        mismatches += reader.Open() && reader.IsPcapng() ? 0 : 1;
+        PcapPacket packet;
+        for (size_t i = 0; i < packets.size(); i++)
+        {
+            const TestPacket& test = packets[i];
+            if (format != 2 && test.linkType != LINKTYPE_BLUETOOTH_BREDR_BB)
+            {
+                continue;
+            }
+            if (reader.Next(packet) == false)
+            {
+                mismatches++;
+                break;
+            }
+            mismatches += packet.linkType != test.linkType || packet.timestampNs != test.timestampNs ? 1 : 0;
+            mismatches += packet.size != test.expected.size() || memcmp(packet.data, test.expected.data(), packet.size) != 0 ? 1 : 0;
+            if (packet.size >= BredrBbHeader::SIZE)
+            {
+                mismatches += (packet.data[20] | packet.data[21] << 8) != test.expectedFlags ? 1 : 0;
+            }
+        }
+        mismatches += reader.Next(packet) || reader.Malformed() ? 1 : 0;
+        fclose(inFile);
+        fclose(outFile);
+    }
+
+    // cut short inside a record
+    FILE* truncatedFile = tmpfile();
+    FILE* outFile = tmpfile();
+    if (truncatedFile != nullptr && outFile != nullptr)
+    {
+        PcapngWriter writer(truncatedFile);
+        writer.AddInterface(LINKTYPE_BLUETOOTH_BREDR_BB);
+        writer.WritePacket(0, 0, packets[0].captured.data(), packets[0].captured.size(), packets[0].captured.size());
+        writer.Flush();
+        long size = ftell(truncatedFile);
+        std::vector<uint8_t> content(size > 0 ? size : 0);
+        rewind(truncatedFile);
+        fread(content.data(), 1, content.size(), truncatedFile);
+        fclose(truncatedFile);
+        truncatedFile = tmpfile();
+        fwrite(content.data(), 1, content.size() - 5, truncatedFile);
+        rewind(truncatedFile);
+        PcapStats stats;
+        mismatches += RunPcap(truncatedFile, outFile, false, 0, stats) ? 1 : 0;
+    }
+    else
+    {
+        mismatches++;
+    }
+    if (truncatedFile != nullptr) fclose(truncatedFile);
+    if (outFile != nullptr) fclose(outFile);
+    return mismatches;
+}
+
+static double BenchBatch(uint32_t threadCount, bool decodePackets, uint32_t recordCount)
+{
+    std::vector<uint8_t> capture;
+    std::vector<uint8_t> data(339, 0xA5);
+    std::vector<uint8_t> payload;
+    size_t bitCount = 0;
+    if (decodePackets)
+    {
+        payload.assign(2, 0);
+        payload[0] = static_cast<uint8_t>(2 | (339 << 3));
+        payload[1] = static_cast<uint8_t>(339 >> 5);
+        payload.resize(2 + 339, 0x5A);
+        EncodePacket(0x6C4F21, 0x47, 0x60, static_cast<uint16_t>(1 | 15 << 3), false, true, payload, 13, data, bitCount);
+    }
+    for (uint32_t record = 0; record < recordCount; record++)
+    {
+        AppendBatchRecord(capture, decodePackets ? 0x60 : record, data.data(), data.size());
+    }
+    std::vector<BatchRecord> records;
+    ParseBatchRecords(capture.data(), capture.size(), records);
+
+    BatchProcessor batch(threadCount);
+    std::vector<uint8_t> output;
+    auto start = std::chrono::steady_clock::now();
+    RunBatch(batch, records, decodePackets, 0x6C4F21, 0x47, output);
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return seconds > 0 ? capture.size() / seconds / 1e6 : 0;
+}
+
+// the parser in whole and in random blocks against sscanf("%2X"), which
+// parseData used to run through fscanf
+static uint32_t VerifyHexParser(uint32_t seed)
+{
+    const char digits[] = "0123456789abcdefABCDEF";
+    const char spaces[] = " \t\r\n";
+    const char invalid[] = "G;z,";
+    uint32_t random = seed | 1;
+    uint32_t mismatches = 0;
+    std::string text;
+
+    for (uint32_t run = 0; run < 2000; run++)
+    {
+        text.clear();
+        size_t tokens = XorShift32(random) % 60;
+        for (size_t token = 0; token < tokens; token++)
+        {
+            size_t digitCount = 1 + XorShift32(random) % (run & 1 ? 2 : 5);
+            for (size_t i = 0; i < digitCount; i++)
+            {
+                text += digits[XorShift32(random) % (sizeof(digits) - 1)];
+            }
+            size_t spaceCount = 1 + XorShift32(random) % 3;
+            for (size_t i = 0; i < spaceCount; i++)
+            {
+                text += spaces[XorShift32(random) % (sizeof(spaces) - 1)];
+            }
+        }
+        if ((run & 3) == 3 && text.size() > 0)
+        {
+            text.insert(XorShift32(random) % text.size(), 1, invalid[XorShift32(random) % (sizeof(invalid) - 1)]);
+        }
+
+        std::vector<uint8_t> expected;
+        const char* cursor = text.c_str();
+        unsigned int value = 0;
+        int consumed = 0;
+        while (sscanf(cursor, "%2X%n", &value, &consumed) == 1)
+        {
+            expected.push_back(value & 0xFF);
+            cursor += consumed;
+        }
+
+        std::vector<uint8_t> whole;
+        HexParser::Parse(text.data(), text.size(), whole);
+        mismatches += whole != expected ? 1 : 0;
+
+        std::vector<uint8_t> blocks;
+        HexParser parser(blocks);
+        size_t offset = 0;
+        while (offset < text.size())
+        {
+            size_t blockSize = 1 + XorShift32(random) % 8;
+            blockSize = blockSize < text.size() - offset ? blockSize : text.size() - offset;
+            parser.Feed(text.data() + offset, blockSize);
+            offset += blockSize;
+        }
+        parser.Finish();
+        mismatches += blocks != expected ? 1 : 0;
+    }
+
+    // text over several internal blocks with bytes split across them, then
+    // binary data stopping in the first block without sizing the output for
+    // the whole of it
+    text.clear();
+    std::vector<uint8_t> expected;
+    while (text.size() < 3 * HexParser::BLOCK_SIZE)
+    {
+        uint32_t value = XorShift32(random);
+        text += digits[value % 16];
+        if (value & 0x100)
+        {
+            text += digits[(value >> 4) % 16];
+            expected.push_back(static_cast<uint8_t>((value % 16) << 4 | (value >> 4) % 16));
+        }
+        else
+        {
+            expected.push_back(static_cast<uint8_t>(value % 16));
+        }
+        text += (value & 0x200) ? " " : "\r\n";
+    }
+    std::vector<uint8_t> parsed;
+    HexParser::Parse(text.data(), text.size(), parsed);
+    mismatches += parsed != expected ? 1 : 0;
+
+    std::string binary(4 * HexParser::BLOCK_SIZE, '\0');
+    binary[0] = '7';
+    parsed.clear();
+    parsed.shrink_to_fit();
+    mismatches += HexParser::Parse(binary.data(), binary.size(), parsed) == 1 ? 0 : 1;
+    mismatches += parsed.capacity() <= HexParser::BLOCK_SIZE ? 0 : 1;
+    return mismatches;
+}
+
+static double BenchHexParser(bool useScanf, size_t byteCount)
+{
+    std::string text;
+    text.reserve(byteCount * 3);
+    const char digits[] = "0123456789ABCDEF";
+    for (size_t i = 0; i < byteCount; i++)
+    {
+        text += digits[(i * 7) & 0xF];
+        text += digits[(i >> 3) & 0xF];
+        text += (i & 15) == 15 ? '\n' : ' ';
+    }
+
+    // the old parseData loop reads from a file, one of its own in the temp
+    // directory
+    std::string benchPath;
+    FILE* textFile = nullptr;
+    if (useScanf)
+    {
+        textFile = CreateTempFile(benchPath);
+        if (textFile == nullptr)
+        {
+            return 0;
+        }
+        bool written = fwrite(text.data(), 1, text.size(), textFile) == text.size();
+        written = fclose(textFile) == 0 && written;
+        textFile = nullptr;
+        if (written)
+        {
+            fopen_s(&textFile, benchPath.c_str(), "rt");
+        }
+        if (textFile == nullptr)
+        {
+            remove(benchPath.c_str());
+            return 0;
+        }
+    }
+
+    std::vector<uint8_t> data;
+    auto start = std::chrono::steady_clock::now();
+    if (useScanf)
+    {
+        uint32_t value = 0;
+        while (fscanf_s(textFile, "%02X", &value) > 0)
+        {
+            data.push_back(value & 0xFF);
+        }
+    }
+    else
+    {
+        HexParser::Parse(text.data(), text.size(), data);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    if (useScanf)
+    {
+        fclose(textFile);
+        remove(benchPath.c_str());
+    }
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return seconds > 0 ? text.size() / seconds / 1e6 : 0;
+}
+
+// random fields through OutputWriter with a buffer small enough to flush
+// mid field run, against the same fields through snprintf
+static uint32_t VerifyOutputWriter(uint32_t seed)
+{
+    uint32_t random = seed | 1;
+    uint32_t mismatches = 0;
+    const size_t bufferSizes[] = { 1, 100, OutputWriter::DEFAULT_BUFFER_SIZE };
+    for (uint32_t run = 0; run < 3; run++)
+    {
+        FILE* file = tmpfile();
+        if (file == nullptr)
+        {
+            mismatches++;
+            continue;
+        }
+        std::string expected;
+        char text[64];
+        {
+            OutputWriter out(file, bufferSizes[run]);
+            for (uint32_t field = 0; field < 20000; field++)
+            {
+                uint32_t value = XorShift32(random);
+                switch (XorShift32(random) % 6)
+                {
+                case 0:
+                {
+                    uint32_t digits = 1 + value % 8;
+                    out.Hex(value, digits);
+                    snprintf(text, sizeof(text), "%0*X", digits, digits == 8 ? value : value & ((1u << (4 * digits)) - 1));
+                    break;
+                }
+                case 1:
+                {
+                    uint8_t bytes[300];
+                    size_t size = value % sizeof(bytes);
+                    std::string hex;
+                    for (size_t i = 0; i < size; i++)
+                    {
+                        bytes[i] = XorShift32(random) & 0xFF;
+                        snprintf(text, sizeof(text), "%02X ", bytes[i]);
+                        hex += text;
+                    }
+                    out.HexBytes(bytes, size);
+                    expected += hex;
+                    text[0] = 0;
+                    break;
+                }
+                case 2:
+                {
+                    uint64_t wide = static_cast<uint64_t>(value) * XorShift32(random) >> (value & 31);
+                    out.Decimal(wide);
+                    snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(wide));
+                    break;
+                }
+                case 3:
+                {
+                    uint32_t count = value % 33;
+                    out.Bits(value, count);
+                    for (uint32_t bit = 0; bit < count; bit++)
+                    {
+                        text[bit] = static_cast<char>('0' + ((value >> bit) & 1));
+                    }
+                    text[count] = 0;
+                    break;
+                }
+                case 4:
+                    out.Text(" uap ");
+                    snprintf(text, sizeof(text), " uap ");
+                    break;
+                default:
+                    out.Char('\n');
+                    snprintf(text, sizeof(text), "\n");
+                    break;
+                }
+                expected += text;
+            }
+        }
+        long size = ftell(file);
+        std::string written(size > 0 ? size : 0, 0);
+        rewind(file);
+        mismatches += fread(&written[0], 1, written.size(), file) != written.size() ? 1 : 0;
+        fclose(file);
+        mismatches += written != expected ? 1 : 0;
+    }
+    return mismatches;
+}
+
+// hex text output of byteCount bytes to a temporary file, printf per byte
+// as every mode printed its result before OutputWriter
+static double BenchOutputWriter(bool usePrintf, size_t byteCount)
+{
+    std::vector<uint8_t> data(byteCount);
+    for (size_t i = 0; i < byteCount; i++)
+    {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    FILE* file = tmpfile();
+    if (file == nullptr)
+    {
+        return 0;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (usePrintf)
+    {
+        for (size_t i = 0; i < byteCount; i++)
+        {
+            fprintf(file, "%02X ", data[i]);
+        }
+        fprintf(file, "\n");
+        fflush(file);
+    }
+    else
+    {
+        OutputWriter out(file);
+        out.HexBytes(data.data(), data.size());
+        out.Char('\n');
+    }
+    auto stop = std::chrono::steady_clock::now();
+    fclose(file);
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return seconds > 0 ? byteCount / seconds / 1e6 : 0;
+}
+
+static double BenchCrc(uint32_t kernel, size_t payloadSize, uint32_t packetCount)
+{
+    std::vector<uint8_t> payload(payloadSize, 0xA5);
+    const BluetoothCrc16& crc16 = BluetoothCrc16::Get();
+    uint32_t check = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t packet = 0; packet < packetCount; packet++)
+    {
+        payload[0] = packet & 0xFF;
+        if (kernel == 0)
+        {
+            check ^= BluetoothCrc::CalcCrcSerial(packet & 0xFF, payload, LfsrEngine::ByteTable);
+        }
+        else
+        {
+            CrcKernel crcKernel = kernel == 1 ? CrcKernel::Table : CrcKernel::ClMul;
+            check ^= crc16.Update(crcKernel, BluetoothCrc16::Seed(packet & 0xFF), payload.data(), payload.size());
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    volatile uint32_t sink = check;
+    (void)sink;
+    return seconds > 0 ? payloadSize * (double)packetCount / seconds / 1e6 : 0;
+}
+
+static double BenchWhitening(bool useLfsr, size_t payloadSize, uint32_t packetCount)
+{
+    std::vector<uint8_t> dataIn(payloadSize, 0xA5);
+    std::vector<uint8_t> dataOut;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t packet = 0; packet < packetCount; packet++)
+    {
+        if (useLfsr)
+        {
+            LinearFeedbackShiftRegister lsfr(7, 0x40 | (packet & 0x3F));
+            lsfr.AddGaloisPoly(0x91);
+            lsfr.AddGeneratorPoly(0x40);
+            lsfr.Shift(static_cast<uint32_t>(payloadSize * 8));
+            std::vector<uint8_t> code = lsfr.GetDataOut(0);
+            dataOut.resize(payloadSize);
+            for (size_t i = 0; i < payloadSize; i++)
+            {
+                dataOut[i] = dataIn[i] ^ code[i];
+            }
+        }
+        else
+        {
+            BluetoothWhitening whitening(packet << 1);
+            whitening.WhitenPayload(dataIn, dataOut);
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return seconds > 0 ? payloadSize * (double)packetCount / seconds / 1e6 : 0;
+}
+
+static double BenchLfsr(LfsrEngine engine, uint32_t regCnt, uint32_t galoisPoly, uint32_t inputPoly, uint32_t bitCount)
+{
+    std::vector<uint8_t> payload((bitCount + 7) / 8, 0xA5);
+    LinearFeedbackShiftRegister lsfr(regCnt, 1, engine);
+    lsfr.AddGaloisPoly(galoisPoly);
+    lsfr.AddGeneratorPoly(1 << (regCnt - 1));
+    lsfr.AddInputPoly(inputPoly);
+
+    auto start = std::chrono::steady_clock::now();
+    lsfr.Shift(bitCount, payload);
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return seconds > 0 ? bitCount / seconds / 1e6 : 0;
+}
+
+static void RunBench()
+{
+    const uint32_t bitCount = 1 << 24;
+    printf("LFSR engine throughput, %u bits per run\n", bitCount);
+    printf("  whitening serial       %8.1f Mbit/s\n", BenchLfsr(LfsrEngine::Serial, 7, 0x91, 0, bitCount));
+    printf("  whitening word         %8.1f Mbit/s\n", BenchLfsr(LfsrEngine::WordParallel, 7, 0x91, 0, bitCount));
+    printf("  whitening byte table   %8.1f Mbit/s\n", BenchLfsr(LfsrEngine::ByteTable, 7, 0x91, 0, bitCount));
+    printf("  crc       serial       %8.1f Mbit/s\n", BenchLfsr(LfsrEngine::Serial, 16, 0x11021, 0x11021, bitCount));
+    printf("  crc       word         %8.1f Mbit/s\n", BenchLfsr(LfsrEngine::WordParallel, 16, 0x11021, 0x11021, bitCount));
+    printf("  crc       byte table   %8.1f Mbit/s\n", BenchLfsr(LfsrEngine::ByteTable, 16, 0x11021, 0x11021, bitCount));
+
+    printf("Whitening throughput, 1021 byte payloads\n");
+    printf("  byte table lfsr        %8.1f MB/s\n", BenchWhitening(true, 1021, 20000));
+    printf("  keystream cache        %8.1f MB/s\n", BenchWhitening(false, 1021, 200000));
+
+    printf("HEC throughput\n");
+    printf("  word lfsr              %8.2f Mheaders/s\n", BenchHec(true, 1 << 18));
+    printf("  table batch            %8.2f Mheaders/s\n", BenchHec(false, 1 << 24));
+
+    printf("FEC 1/3 header decode throughput\n");
+    printf("  single header          %8.2f Mheaders/s\n", BenchFec13(false, 1 << 22));
+    printf("  batch                  %8.2f Mheaders/s\n", BenchFec13(true, 1 << 22));
+
+    printf("Packet decode throughput\n");
+    printf("  DM1 17 bytes           %8.2f Mpackets/s\n", BenchPacketDecoder(3, 17, 1 << 20));
+    printf("  DH1 27 bytes           %8.2f Mpackets/s\n", BenchPacketDecoder(4, 27, 1 << 20));
+    printf("  DM5 224 bytes          %8.2f Mpackets/s\n", BenchPacketDecoder(14, 224, 1 << 18));
+    printf("  DH5 339 bytes          %8.2f Mpackets/s\n", BenchPacketDecoder(15, 339, 1 << 18));
+
+    printf("Hex text parsing throughput\n");
+    printf("  fscanf %%02X            %8.1f MB/s\n", BenchHexParser(true, 1 << 22));
+    printf("  lookup table           %8.1f MB/s\n", BenchHexParser(false, 1 << 24));
+
+    printf("Hex text output throughput, input bytes\n");
+    printf("  printf %%02X per byte   %8.1f MB/s\n", BenchOutputWriter(true, 1 << 22));
+    printf("  OutputWriter           %8.1f MB/s\n", BenchOutputWriter(false, 1 << 24));
+
+    uint32_t hardwareThreads = std::thread::hardware_concurrency();
+    printf("Batch throughput, 339 byte records\n");
+    printf("  whiten  1 thread       %8.1f MB/s\n", BenchBatch(1, false, 100000));
+    printf("  whiten %2u threads      %8.1f MB/s\n", hardwareThreads, BenchBatch(hardwareThreads, false, 100000));
+    printf("  DH5     1 thread       %8.1f MB/s\n", BenchBatch(1, true, 100000));
+    printf("  DH5    %2u threads      %8.1f MB/s\n", hardwareThreads, BenchBatch(hardwareThreads, true, 100000));
+
+    printf("Clock recovery throughput, all 64 seeds per header\n");
+    printf("  known uap              %8.2f Mheaders/s\n", BenchClockRecovery(true, 1 << 22));
+    printf("  unknown uap            %8.2f Mheaders/s\n", BenchClockRecovery(false, 1 << 22));
+
+    printf("CRC-16 throughput\n");
+    const size_t crcSizes[] = { 27, 339, 1021, 65536 };
+    for (size_t sizeIndex = 0; sizeIndex < sizeof(crcSizes) / sizeof(crcSizes[0]); sizeIndex++)
+    {
+        size_t size = crcSizes[sizeIndex];
+        uint32_t packets = static_cast<uint32_t>((200u << 20) / size);
+        printf("  %5zu bytes byte table lfsr  %8.1f MB/s\n", size, BenchCrc(0, size, packets / 64));
+        printf("  %5zu bytes slicing by 8     %8.1f MB/s\n", size, BenchCrc(1, size, packets));
+        if (BluetoothCrc16::Get().HasClMul())
+        {
+            printf("  %5zu bytes clmul folding    %8.1f MB/s\n", size, BenchCrc(2, size, packets));
+        }
+        else
+        {
+            printf("  %5zu bytes clmul folding    not supported on this cpu\n", size);
+        }
+    }
+
+    printf("LFSR JumpAhead cost, 16 register crc\n");
+    LinearFeedbackShiftRegister jumper(16, 1);
+    jumper.AddGaloisPoly(0x11021);
+    jumper.AddGeneratorPoly(1 << 15);
+    jumper.JumpAhead(1);
+    const uint32_t jumpCount = 100000;
+    for (uint64_t jumpBits = 16; jumpBits != 0 && jumpBits <= (1ull << 60); jumpBits <<= 8)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < jumpCount; i++)
+        {
+            jumper.JumpAhead(jumpBits + i);
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        printf("  jump %20llu bits %8.1f ns\n", (unsigned long long)jumpBits, seconds * 1e9 / jumpCount);
+    }
+}
+
+std::vector<std::string> unitTests =
+{
+    unitTestWhitening,
+    unitTestWhiteningPayload,
+    unitTestWhiteningNoAlloc,
+    unitTestWhiteningBits,
+    unitTestWhiteningBitsOffset,
+    unitTestHec,
+    unitTestHecQuiet,
+    unitTestHecTable,
+    unitTestUapRecovery,
+    unitTestClockRecovery,
+    unitTestClockUapRecovery,
+    unitTestClockUapRecoveryQuiet,
+    unitTestCrc,
+    unitTestCrcBinary,
+    unitTestCrcRandom,
+    unitTestFec23,
+    unitTestFec23Binary,
+    unitTestFec23Decode,
+    unitTestFec23Random,
+    unitTestFec13,
+    unitTestFec13Random,
+    unitTestSyncWord,
+    unitTestPacketDecode,
+    unitTestPacketDecodeRandom,
+    unitTestBatch,
+    unitTestBatchRandom,
+    unitTestStreamRandom,
+    unitTestPcapRandom,
+    unitTestHexParser,
+    unitTestOutputWriter,
+    unitTestLfsr
+};
+
+void printhelp(const char* exeName)
+{
+    printf("%s [BluetoothClk] [[testData] or [filename]]\n", exeName);
+    printf("%s --k [--ua uap] [[testData] or [filename]]\n", exeName);
+    printf("--k: finds the clock from records of clock ticks since the first header and 3 whitened header bytes\n");
+    printf("%s --pkt BluetoothClk lap0 lap1 lap2 uap [[rawBits] or [filename]]\n", exeName);
+    printf("--pkt: decodes a packet from raw demodulated bits, first bit in bit 0\n");
+    printf("%s --batch [--threads count] [--lap lap --ua uap] [--o outputFile] [[testData] or [filename]]\n", exeName);
+    printf("--batch: records of a 4 byte clock, 2 byte length and data, all low byte first, on every core\n");
+    printf("%s --stream [--hex] [--lap lap --ua uap] < records > records\n", exeName);
+    printf("--stream: --batch records from stdin to stdout in fixed memory, --hex writes a line of hex per record\n");
+    printf("%s --pcap captureFile [--ua uap] [--o outputFile]\n", exeName);
+    printf("--pcap: dewhitens, HEC and CRC checks LINKTYPE_BLUETOOTH_BREDR_BB packets of a pcap or pcapng file, - for stdin,\n");
+    printf("        into annotated pcapng, stdout without --o. Without --ua the reference UAP of each packet is used\n");
+    printf("--q: no line per record or summary, only the result bytes as hex text\n");
+    printf("--bin: results as raw bytes on stdout instead of hex text, implies --q\n");
+    printf("BluetoothClk: only bits 1 - 6 inclusive are used\n");
+    printf("testData: space separated 2 digit hex bytes\n");
+    printf("filename: the file can be text with space separated 2 digit hex bytes, or binary. Detection is automatic.\n");
+    printf("Example: %s 60 10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09\n", exeName);
+    printf("Output: \n");
+//    printf("%s\n", exeName);
+}
+
+// Everything one command line run reads and writes. Each run, and each unit
+// test, gets a fresh one instead of resetting globals.
+struct CommandContext
+{
+    std::vector<uint8_t> testData;
+    std::vector<uint8_t> expectedData;
+    std::vector<uint8_t> dataOut;
+    uint8_t seed = 0;
+    bool seedByteParsed = false;
+    bool forcebinaryFile = false;
+    bool crcMode = false;
+    bool crcVerifyMode = false;
+    bool fecMode = false;
+    bool fecDecodeMode = false;
+    bool fecVerifyMode = false;
+    bool fec13Mode = false;
+    bool fec13VerifyMode = false;
+    bool syncWordMode = false;
+    bool packetMode = false;
+    bool packetVerifyMode = false;
+    bool hecMode = false;
+    bool hecVerifyMode = false;
+    bool uapMode = false;
+    bool clockMode = false;
+    bool uapParsed = false;
+    uint8_t uapArg = 0;
+    bool lfsrMode = false;
+    bool payloadMode = false;
+    bool noAllocMode = false;
+    bool bitsMode = false;
+    size_t bitOffset = 0;
+    size_t bitLength = 0;
+    bool testResults = false;
+    bool hopTest = false;
+    bool batchMode = false;
+    bool batchVerifyMode = false;
+    bool streamMode = false;
+    std::string pcapFile;
+    bool pcapVerifyMode = false;
+    bool outputVerifyMode = false;
+    bool streamVerifyMode = false;
+    bool hexOutput = false;
+    Verbosity verbosity = Verbosity::Normal;
+    // results as raw bytes instead of hex text, implies quiet
+    bool binaryOutput = false;
+    bool hexVerifyMode = false;
+    uint32_t threadCount = 0;
+    bool lapParsed = false;
+    uint32_t lapArg = 0;
+    std::string outputFile;
+    // a binary capture given as the only input stays mapped instead of being read into testData
+    std::shared_ptr<MappedFile> mappedInput;
+    bool runUnitTests = false;
+
+    const uint8_t* InputData() const { return mappedInput ? mappedInput->Data() : testData.data(); }
+    size_t InputSize() const { return mappedInput ? mappedInput->Size() : testData.size(); }
+
+    // for the modes that work on testData itself
+    void CopyMappedInput()
+    {
+        if (mappedInput)
+        {
+            testData.assign(mappedInput->Data(), mappedInput->Data() + mappedInput->Size());
+            mappedInput.reset();
+        }
+    }
+};
+
+// mapping may be null, otherwise a binary file that is the first input is
+// mapped into it rather than copied into data
+static void parseData(const char* arg, std::vector<uint8_t>& data, bool forcebinaryFile, std::shared_ptr<MappedFile>* mapping)
+{
+    char* endPtr = nullptr;
+    uint32_t temp = 0;
+
+    if (mapping != nullptr && *mapping)
+    {
+        // more input after a mapped file, fall back to one buffer
+        data.insert(data.end(), (*mapping)->Data(), (*mapping)->Data() + (*mapping)->Size());
+        mapping->reset();
+    }
+
+    temp = strtol(arg, &endPtr, 16);
+    if (endPtr != arg)
+    {
+        data.push_back(temp & 0xFF);
+    }
+    else
+    {
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+        std::vector<uint8_t> streamData;
+        const uint8_t* fileData = nullptr;
+        size_t fileSize = 0;
+        if (file->Open(arg))
+        {
+            fileData = file->Data();
+            fileSize = file->Size();
+        }
+        else
+        {
+            // pipes and devices can't be mapped, read them in blocks
+            FILE* dataFile = nullptr;
+            fopen_s(&dataFile, arg, "rb");
+            if (dataFile == nullptr)
+            {
+                return;
+            }
+            const size_t blockSize = 1 << 20;
+            size_t bytesRead = 0;
+            do
+            {
+                size_t startIndex = streamData.size();
+                streamData.resize(startIndex + blockSize);
+                bytesRead = fread(&streamData[startIndex], 1, blockSize, dataFile);
+                streamData.resize(startIndex + bytesRead);
+            } while (bytesRead == blockSize);
+            fclose(dataFile);
+            file.reset();
+            fileData = streamData.data();
+            fileSize = streamData.size();
+        }
+
+        size_t bytesParsed = 0;
+        if (forcebinaryFile == false)
+        {
+            bytesParsed = HexParser::Parse(reinterpret_cast<const char*>(fileData), fileSize, data);
+        }
+        if (bytesParsed == 0)
+        {
+            if (file && mapping != nullptr && data.empty())
+            {
+                *mapping = file;
+            }
+            else
+            {
+                data.insert(data.end(), fileData, fileData + fileSize);
+            }
+        }
+    }
+}
+
+static void parseArgs(const std::vector<std::string>& args, CommandContext& ctx)
+{
+    uint32_t temp = 0;
+    ctx = CommandContext();
+
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        char* endPtr = nullptr;
+
+        if(args[i] == "--hop")
+        {
+            TestHop();
+            exit(0);
+        }
+        else if (args[i] == "--u")
+        {
+            ctx.runUnitTests = true;
+            return;
+        }
+        else if (args[i] == "--hec")
+        {
+            ctx.hecMode = true;
+        }
+        else if (args[i] == "--hv")
+        {
+            ctx.hecVerifyMode = true;
+        }
+        else if (args[i] == "--uap")
+        {
+            ctx.uapMode = true;
+        }
+        else if (args[i] == "--k")
+        {
+            ctx.clockMode = true;
+        }
+        else if (args[i] == "--ua")
+        {
+            i++;
+            if (i < args.size())
+            {
+                temp = strtol(args[i].c_str(), &endPtr, 16);
+                if (endPtr == args[i].c_str())
+                {
+                    printf("Unable to parse uap %s\n", args[i].c_str());
+                    exit(-1);
+                }
+                ctx.uapParsed = true;
+                ctx.uapArg = temp & 0xFF;
+            }
+        }
+        else if (args[i] == "--e")
+        {
+            ctx.testResults = true;
+        }
+        else if (args[i] == "--b")
+        {
+            ctx.forcebinaryFile = true;
+        }
+        else if (args[i] == "--f")
+        {
+            ctx.fecMode = true;
+        }
+        else if (args[i] == "--fd")
+        {
+            ctx.fecDecodeMode = true;
+        }
+        else if (args[i] == "--fv")
+        {
+            ctx.fecVerifyMode = true;
+        }
+        else if (args[i] == "--f13")
+        {
+            ctx.fec13Mode = true;
+        }
+        else if (args[i] == "--f13v")
+        {
+            ctx.fec13VerifyMode = true;
+        }
+        else if (args[i] == "--sync")
+        {
+            ctx.syncWordMode = true;
+        }
+        else if (args[i] == "--pkt")
+        {
+            ctx.packetMode = true;
+        }
+        else if (args[i] == "--pktv")
+        {
+            ctx.packetVerifyMode = true;
+        }
+        else if (args[i] == "--batch")
+        {
+            ctx.batchMode = true;
+        }
+        else if (args[i] == "--batchv")
+        {
+            ctx.batchVerifyMode = true;
+        }
+        else if (args[i] == "--stream")
+        {
+            ctx.streamMode = true;
+        }
+        else if (args[i] == "--streamv")
+        {
+            ctx.streamVerifyMode = true;
+        }
+        else if (args[i] == "--hex")
+        {
+            ctx.hexOutput = true;
+        }
+        else if (args[i] == "--outv")
+        {
+            ctx.outputVerifyMode = true;
+        }
+        else if (args[i] == "--q")
+        {
+            ctx.verbosity = Verbosity::Quiet;
+        }
+        else if (args[i] == "--bin")
+        {
+            ctx.binaryOutput = true;
+            ctx.verbosity = Verbosity::Quiet;
+        }
+        else if (args[i] == "--pcap")
+        {
+            i++;
+            if (i < args.size())
+            {
+                ctx.pcapFile = args[i];
+            }
+        }
+        else if (args[i] == "--pcapv")
+        {
+            ctx.pcapVerifyMode = true;
+        }
+        else if (args[i] == "--hexv")
+        {
+            ctx.hexVerifyMode = true;
+        }
+        else if (args[i] == "--threads" || args[i] == "--lap")
+        {
+            bool isThreads = args[i] == "--threads";
+            i++;
+            if (i < args.size())
+            {
+                temp = strtol(args[i].c_str(), &endPtr, isThreads ? 10 : 16);
+                if (endPtr == args[i].c_str())
+                {
+                    printf("Unable to parse %s %s\n", isThreads ? "thread count" : "lap", args[i].c_str());
+                    exit(-1);
+                }
+                if (isThreads)
+                {
+                    ctx.threadCount = temp;
+                }
+                else
+                {
+                    ctx.lapParsed = true;
+                    ctx.lapArg = temp & 0xFFFFFF;
+                }
+            }
+        }
+        else if (args[i] == "--o")
         {
-            TestHop();
-            exit(0);
+            i++;
+            if (i < args.size())
+            {
+                ctx.outputFile = args[i];
+            }
         }
-        else if (args[i] == "--u")
+        else if (args[i] == "--c")
         {
-            unitTestIndex = 0;
-            return;
+            ctx.crcMode = true;
         }
-        else if (args[i] == "--hec")
+        else if (args[i] == "--cv")
         {
-            hecMode = true;
+            ctx.crcVerifyMode = true;
         }
-        else if (args[i] == "--e")
+        else if (args[i] == "--l")
         {
-            testResults = true;
+            ctx.lfsrMode = true;
         }
-        else if (args[i] == "--b")
+        else if (args[i] == "--p")
         {
-            forcebinaryFile = true;
+            ctx.payloadMode = true;
         }
-        else if (args[i] == "--f")
+        else if (args[i] == "--z")
         {
-            fecMode = true;
+            ctx.noAllocMode = true;
         }
-        else if (args[i] == "--c")
+        else if (args[i] == "--w")
+        {
+            ctx.bitsMode = true;
+        }
+        else if (args[i] == "--bo" || args[i] == "--bl")
+        {
+            bool isOffset = args[i] == "--bo";
+            i++;
+            if (i < args.size())
+            {
+                temp = strtol(args[i].c_str(), &endPtr, 10);
+                if (endPtr == args[i].c_str())
+                {
+                    printf("Unable to parse bit %s %s\n", isOffset ? "offset" : "length", args[i].c_str());
+                    exit(-1);
+                }
+                (isOffset ? ctx.bitOffset : ctx.bitLength) = temp;
+            }
+        }
+        else if (args[i] == "--bench")
         {
-            crcMode = true;
+            RunBench();
+            exit(0);
         }
-        else if (seedByteParsed == false)
+        else if (ctx.seedByteParsed == false && ctx.clockMode == false && ctx.batchMode == false)
         {
             temp = strtol(args[i].c_str() , &endPtr, 16);
             if (endPtr != args[i].c_str())
@@ -377,40 +2672,56 @@ static void parseArgs(std::vector<std::string> args)
                 {
                     printf("Warning Bluetooth clock has too many bits! Only using lowest 7 bits!\n");
                 }
-                seedByteParsed = true;
-                seed = temp;
+                ctx.seedByteParsed = true;
+                ctx.seed = temp;
             }
         }
         else
         {
-            if (testResults)
+            if (ctx.testResults)
             {
-                parseData(args[i].c_str(), expectedData);
+                parseData(args[i].c_str(), ctx.expectedData, ctx.forcebinaryFile, nullptr);
             }
             else
             {
-                parseData(args[i].c_str(), testData);
+                parseData(args[i].c_str(), ctx.testData, ctx.forcebinaryFile, &ctx.mappedInput);
             }
         }
     }
 }
 
+// the result of a mode, raw bytes with --bin, otherwise the hex text the tools exchange
+static void WriteResult(const CommandContext& ctx, const std::vector<uint8_t>& data, OutputWriter& out)
+{
+    if (ctx.binaryOutput)
+    {
+        out.Write(data.data(), data.size());
+        return;
+    }
+    out.HexBytes(data.data(), data.size());
+    out.Char('\n');
+}
+
 void TestHop();
 
 int main(int argc, const char* argv[])
 {
     int iterations = 1;
+    int unitTestIndex = -1;
+    int unitTestPassed = 0;
     std::vector<std::string> args;
+    CommandContext ctx;
 
     for (int i = 0; i < argc; i++)
     {
         args.push_back(argv[i]);
     }
 
-    parseArgs(args);
+    parseArgs(args, ctx);
 
-    if (unitTestIndex >= 0)
+    if (ctx.runUnitTests)
     {
+        unitTestIndex = 0;
         iterations = unitTests.size();
     }
 
@@ -436,123 +2747,696 @@ int main(int argc, const char* argv[])
                     tempIndex = 0;
                 }
             }
-            parseArgs(args);
+            parseArgs(args, ctx);
             delete[] tempString;
         }
-        if (seedByteParsed == false)
+        if (ctx.pcapFile.empty() == false)
+        {
+            // --pcap capture.pcap [--ua uap] [--o annotated.pcapng]
+            FILE* inFile = stdin;
+            FILE* outFile = stdout;
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            if (ctx.pcapFile != "-")
+            {
+                fopen_s(&inFile, ctx.pcapFile.c_str(), "rb");
+            }
+            if (ctx.outputFile.empty() == false)
+            {
+                fopen_s(&outFile, ctx.outputFile.c_str(), "wb");
+            }
+            if (inFile == nullptr || outFile == nullptr)
+            {
+                fprintf(stderr, "Unable to open %s\n", inFile == nullptr ? ctx.pcapFile.c_str() : ctx.outputFile.c_str());
+                exit(-4);
+            }
+            PcapStats stats;
+            bool complete = RunPcap(inFile, outFile, ctx.uapParsed, ctx.uapArg, stats);
+            if (complete == false)
+            {
+                fprintf(stderr, "Not a capture or damaged after %zu packets\n", stats.packets);
+            }
+            if (ctx.verbosity != Verbosity::Quiet)
+            {
+                fprintf(stderr, "packets %zu bredr %zu clocks recovered %zu hec valid %zu crc valid %zu\n",
+                    stats.packets, stats.bredrPackets, stats.clocksRecovered, stats.hecValid, stats.crcValid);
+            }
+            if (inFile != stdin)
+            {
+                fclose(inFile);
+            }
+            if (outFile != stdout)
+            {
+                fclose(outFile);
+            }
+            exit(complete ? 0 : -4);
+        }
+        if (ctx.streamMode)
+        {
+            // --stream [--hex] [--lap lap --ua uap] < capture > output
+            // stdout only carries records, the summary goes to stderr
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+            if (ctx.hexOutput == false)
+            {
+                _setmode(_fileno(stdout), _O_BINARY);
+            }
+#endif
+            size_t recordCount = 0;
+            auto start = std::chrono::steady_clock::now();
+            bool complete = RunStream(stdin, stdout, ctx.hexOutput, ctx.lapParsed, ctx.lapArg, ctx.uapArg, RecordStream::DEFAULT_BUFFER_SIZE, recordCount);
+            auto stop = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(stop - start).count();
+            if (complete == false)
+            {
+                fprintf(stderr, "Truncated record after %zu records\n", recordCount);
+            }
+            if (ctx.verbosity != Verbosity::Quiet)
+            {
+                fprintf(stderr, "records %zu %.3f s\n", recordCount, seconds);
+            }
+            exit(complete ? 0 : -4);
+        }
+        if (ctx.seedByteParsed == false && ctx.clockMode == false && ctx.batchMode == false)
         {
             printf("No valid Bluetooth clock value detected!\n");
             printhelp(argv[0]);
             exit(-2);
         }
-        if (testData.size() < 3)
+        if (ctx.batchMode == false)
+        {
+            ctx.CopyMappedInput();
+        }
+        if (ctx.InputSize() < 3 && ctx.lfsrMode == false && ctx.hecVerifyMode == false && ctx.crcVerifyMode == false && ctx.fecVerifyMode == false && ctx.fec13VerifyMode == false && ctx.packetVerifyMode == false && ctx.batchVerifyMode == false && ctx.streamVerifyMode == false && ctx.pcapVerifyMode == false && ctx.outputVerifyMode == false && ctx.hexVerifyMode == false && ctx.payloadMode == false && ctx.bitsMode == false)
         {
             printf("Insufficient data for test. Bluetooth header is 18 bits, user must supply at least 3 bytes of data!\n");
             printhelp(argv[0]);
             exit(-3);
         }
 
-        if (hecMode)
+#ifdef _WIN32
+        if (ctx.binaryOutput)
+        {
+            _setmode(_fileno(stdout), _O_BINARY);
+        }
+#endif
+        // per record output and results, flushed before the test results
+        OutputWriter out(stdout);
+        const bool perRecord = ctx.verbosity != Verbosity::Quiet;
+
+        if (ctx.lfsrMode)
+        {
+            // --l 5A --e 00
+            uint32_t mismatches = VerifyLfsrEngines(ctx.seed);
+            uint32_t whiteningMismatches = VerifyWhiteningKeystream(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches + whiteningMismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("lfsr engine mismatches %u\n", mismatches);
+                printf("whitening keystream mismatches %u\n", whiteningMismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.hecVerifyMode)
+        {
+            // --hv 5A --e 00
+            uint32_t mismatches = VerifyHec();
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("hec mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.hecMode)
         {
             // --hec 47 00 23 01 47 23 01 00 24 01 47 24 01 00 25 01 47 25 01 00 26 01 47 26 01 00 27 01 47 27 01 00 1B 01 47 1B 01 00 1C 01 47 1C 01 00 1D 01 47 1D 01 00 1E 01 47 1E 01 00 1F 01 47 1F 01 --e E1 06 32 D5 5A BD E2 05 8A 6D 9E 79 4D AA 25 C2 9D 7A F5 12
             // --hec 47 00 23 01 --e E1
-            uint8_t hecVal = 0;
             BluetoothHec hec(0);
-            auto testDataIt = testData.begin();
-            dataOut.clear();
-            for (size_t i = 0; (i + 2) < testData.size(); i += 3, testDataIt+=3)
+            size_t headerCount = ctx.testData.size() / 3;
+            std::vector<uint8_t> uaps(headerCount);
+            std::vector<uint16_t> headers(headerCount);
+            for (size_t i = 0; i < headerCount; i++)
+            {
+                uaps[i] = ctx.testData[i * 3];
+                headers[i] = ctx.testData[i * 3 + 1] | (ctx.testData[i * 3 + 2] << 8);
+            }
+            ctx.dataOut.resize(headerCount);
+            hec.CalcHec(uaps.data(), headers.data(), headerCount, ctx.dataOut.data());
+
+            for (size_t i = 0; perRecord && i < headerCount; i++)
+            {
+                out.Text("uap ");
+                out.Hex(uaps[i], 2);
+                out.Text(" data ");
+                out.Hex(ctx.testData[i * 3 + 1], 2);
+                out.Char(' ');
+                out.Hex(ctx.testData[i * 3 + 2], 2);
+                out.Text(" hec ");
+                out.Hex(ctx.dataOut[i], 2);
+                out.Char('\n');
+            }
+            if (perRecord == false)
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.clockMode)
+        {
+            // --k --ua 47 00 EE 88 00 1A 1E BE 02 6E 16 5F 01 --e 10
+            // --k 00 EE 88 00 1A 1E BE 02 6E 16 5F 01 --e 10 47 50 91
+            // records of clock ticks since the first header, 3 whitened header bytes
+            ClockRecovery recovery;
+            for (size_t index = 0; index + 4 <= ctx.testData.size(); index += 4)
             {
-                std::vector<uint8_t> fecData(testDataIt+1, testDataIt + 3);
-                hec.CalcHec(testDataIt[0], fecData, hecVal);
+                if (ctx.uapParsed)
+                {
+                    recovery.AddHeader(ctx.uapArg, &ctx.testData[index + 1], ctx.testData[index]);
+                }
+                else
+                {
+                    recovery.AddHeader(&ctx.testData[index + 1], ctx.testData[index]);
+                }
+            }
 
-                printf("uap %02X data %02X %02X hec %02X\n", testDataIt[0], fecData[0], fecData[1], hecVal);
+            ctx.dataOut.clear();
+            uint64_t validClocks = recovery.GetValidClocks();
+            for (uint32_t clk6 = 0; clk6 < ClockRecovery::SEED_COUNT; clk6++)
+            {
+                if ((validClocks >> clk6) & 1)
+                {
+                    uint8_t clock = static_cast<uint8_t>(clk6 << 1);
+                    uint8_t uap = ctx.uapParsed ? ctx.uapArg : recovery.GetPairUap(clock);
+                    if (perRecord)
+                    {
+                        out.Text("clock ");
+                        out.Hex(clock, 2);
+                        out.Text(" uap ");
+                        out.Hex(uap, 2);
+                        out.Char('\n');
+                    }
+                    ctx.dataOut.push_back(clock);
+                    if (ctx.uapParsed == false)
+                    {
+                        ctx.dataOut.push_back(uap);
+                    }
+                }
+            }
+            if (perRecord)
+            {
+                out.Text("headers ");
+                out.Decimal(recovery.GetHeaderCount());
+                out.Text(" candidates ");
+                out.Decimal(ctx.uapParsed ? ctx.dataOut.size() : ctx.dataOut.size() / 2);
+                out.Char('\n');
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.uapMode)
+        {
+            // --uap 00 10 EE 88 00 00 2A 1E BE 02 00 7E 16 5F 01 00 36 60 54 02 0C 06 97 75 FB E7 43 EF AC D8 97 3E E1 --e 47 05
+            // records of clock, 3 whitened header bytes, payload length, whitened payload ending in its CRC
+            UapRecovery recovery;
+            size_t index = 0;
+            while (index + 5 <= ctx.testData.size())
+            {
+                uint8_t clock = ctx.testData[index];
+                const uint8_t* header = &ctx.testData[index + 1];
+                size_t payloadSize = ctx.testData[index + 4];
+                index += 5;
+                if (index + payloadSize > ctx.testData.size())
+                {
+                    fprintf(stderr, "Truncated payload at record %u\n", recovery.GetPacketCount());
+                    break;
+                }
+                recovery.AddPacket(clock, header, payloadSize != 0 ? &ctx.testData[index] : nullptr, payloadSize);
+                index += payloadSize;
+            }
 
-                dataOut.push_back(hecVal);
+            uint8_t uap = 0;
+            uint32_t score = 0;
+            bool converged = recovery.GetUap(uap, score);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(uap);
+            ctx.dataOut.push_back(score & 0xFF);
+            if (perRecord)
+            {
+                printf("packets %u uap %02X score %u %s\n", recovery.GetPacketCount(), uap, score, converged ? "converged" : "not converged");
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.crcVerifyMode)
+        {
+            // --cv 5A --e 00
+            uint32_t mismatches = VerifyCrc(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("crc mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
             }
         }
-        else if (crcMode)
+        else if (ctx.crcMode)
         {
             // --c 47 4E 01 02 03 04 05 06 07 08 09 6D D2
             uint16_t crcVal;
-            BluetoothCrc crcGen(seed);
-            crcGen.CalcCrc(testData, crcVal);
-            printf("uap %02X crc %04X\n", seed, crcVal);
-            dataOut.resize(2);
-            dataOut[0] = crcVal & 0xFF;
-            dataOut[1] = (crcVal >> 8) & 0xFF;
+            BluetoothCrc crcGen(ctx.seed);
+            crcVal = crcGen.CalcCrc(ctx.seed, ctx.testData.data(), ctx.testData.size());
+            ctx.dataOut.resize(2);
+            ctx.dataOut[0] = crcVal & 0xFF;
+            ctx.dataOut[1] = (crcVal >> 8) & 0xFF;
+            if (perRecord)
+            {
+                printf("uap %02X crc %04X\n", ctx.seed, crcVal);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
         }
-        else if (fecMode)
+        else if (ctx.fecMode)
         {
             // --f 00 01 00 02 00 04 00 08 00 10 00 20 00 40 00 80 00 00 01 00 02
-            uint8_t parity = 0;
-            BluetoothFec23 fec;
-            auto testDataIt = testData.begin();
-            dataOut.clear();
-            for (size_t i = 0; (i + 1) < testData.size(); i += 2)
-            {
-                std::vector<uint8_t> fecData(testDataIt, testDataIt + 2);
-                testDataIt += 2;
-                fec.CalcParity(fecData, parity);
-                printf("parity %02X: ", parity);
-                for (int i = 0; i < 10; i++)
+            const BluetoothFec23& fec = BluetoothFec23::Get();
+            ctx.dataOut.clear();
+            for (size_t i = 0; (i + 1) < ctx.testData.size(); i += 2)
+            {
+                uint16_t data = ctx.testData[i] | ctx.testData[i + 1] << 8;
+                uint8_t parity = fec.CalcParity(data);
+                if (perRecord)
+                {
+                    out.Text("parity ");
+                    out.Hex(parity, 2);
+                    out.Text(": ");
+                    out.Bits(data, 10);
+                    out.Char(' ');
+                    out.Bits(parity, 5);
+                    out.Char('\n');
+                }
+                ctx.dataOut.push_back(parity);
+            }
+            if (perRecord == false)
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.fecDecodeMode)
+        {
+            // --fd 00 2B C5 68 23 1B 0A --e 23 45 CB 06 02 01
+            // packed 15 bit blocks in, packed data bits then corrected and uncorrectable block counts out
+            const BluetoothFec23& fec = BluetoothFec23::Get();
+            size_t blockCount = ctx.testData.size() * 8 / BluetoothFec23::BLOCK_BITS;
+            ctx.dataOut.resize((blockCount * BluetoothFec23::bluetoothFec23PayloadBitCnt + 7) / 8);
+            size_t corrected = 0;
+            size_t uncorrectable = fec.Decode(ctx.testData.data(), blockCount, ctx.dataOut.data(), &corrected);
+            ctx.dataOut.push_back(corrected & 0xFF);
+            ctx.dataOut.push_back(uncorrectable & 0xFF);
+            if (perRecord)
+            {
+                printf("blocks %zu corrected %zu uncorrectable %zu\n", blockCount, corrected, uncorrectable);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.syncWordMode)
+        {
+            // --sync 00 33 8B 9E --e E2 3A 1A 33 CE 2C 7A 4E
+            // LAP low byte first in, sync word bit 0 first out
+            uint32_t lap = ctx.testData[0] | ctx.testData[1] << 8 | ctx.testData[2] << 16;
+            uint64_t syncWord = PacketDecoder::SyncWord(lap);
+            ctx.dataOut.clear();
+            for (uint32_t i = 0; i < 8; i++)
+            {
+                ctx.dataOut.push_back((syncWord >> (8 * i)) & 0xFF);
+            }
+            if (perRecord)
+            {
+                printf("lap %06X sync word %016llX\n", lap, static_cast<unsigned long long>(syncWord));
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.packetMode)
+        {
+            // --pkt 60 21 4F 6C 47 92 51 E2 8C A1 F8 C2 9E D8 58 C5 0B FC C7 71 00 38 C8 9E 25 30 D7 92 F0 AB DE D0 30 62 20 01 --e 99 D6 01 07 48 65 6C 6C 6F
+            // LAP low byte first and UAP, then raw bits first bit in bit 0
+            // header, flags of sync bit 0, HEC bit 1 and CRC bit 2, then payload body out
+            uint32_t lap = ctx.testData[0] | ctx.testData[1] << 8 | ctx.testData[2] << 16;
+            PacketDecoder decoder(lap, ctx.testData[3]);
+            DecodedPacket packet;
+            decoder.Decode(ctx.testData.data() + 4, (ctx.testData.size() - 4) * 8, ctx.seed, packet);
+            ctx.dataOut.clear();
+            for (uint32_t i = 0; i < BluetoothFec13::HEADER_BYTES; i++)
+            {
+                ctx.dataOut.push_back((packet.header >> (8 * i)) & 0xFF);
+            }
+            ctx.dataOut.push_back((packet.syncFound ? 1 : 0) | (packet.hecValid ? 2 : 0) | (packet.crcValid ? 4 : 0));
+            if (packet.payloadComplete)
+            {
+                ctx.dataOut.insert(ctx.dataOut.end(), packet.payload + packet.bodyOffset, packet.payload + packet.payloadSize);
+            }
+            if (perRecord)
+            {
+                printf("sync %u offset %zu errors %u header %05X hec %u type %u lt addr %u length %u crc %u fec corrected %zu uncorrectable %zu\n",
+                    packet.syncFound, packet.syncOffset, packet.syncErrors, packet.header, packet.hecValid, packet.type, packet.ltAddr,
+                    packet.length, packet.crcValid, packet.fecCorrected, packet.fecUncorrectable);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.batchMode)
+        {
+            // --batch --threads 4 60 00 00 00 15 00 10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09
+            // [--lap lap --ua uap] [--o outputFile] capture of clock, length, data records
+            // without a lap records are dewhitened, with one they are decoded as packets
+            std::vector<BatchRecord> records;
+            if (ParseBatchRecords(ctx.InputData(), ctx.InputSize(), records) == false)
+            {
+                fprintf(stderr, "Truncated record after %zu records\n", records.size());
+            }
+            BatchProcessor batch(ctx.threadCount);
+            auto start = std::chrono::steady_clock::now();
+            RunBatch(batch, records, ctx.lapParsed, ctx.lapArg, ctx.uapArg, ctx.dataOut);
+            auto stop = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(stop - start).count();
+            if (perRecord)
+            {
+                printf("records %zu threads %u output bytes %zu %.3f s\n", records.size(), batch.GetThreadCount(), ctx.dataOut.size(), seconds);
+            }
+
+            if (ctx.outputFile.empty() == false)
+            {
+                FILE* outFile = nullptr;
+                fopen_s(&outFile, ctx.outputFile.c_str(), "wb");
+                if (outFile == nullptr)
+                {
+                    fprintf(stderr, "Unable to open %s\n", ctx.outputFile.c_str());
+                    exit(-4);
+                }
+                fwrite(ctx.dataOut.data(), 1, ctx.dataOut.size(), outFile);
+                fclose(outFile);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.hexVerifyMode)
+        {
+            // --hexv 5A --e 00
+            uint32_t mismatches = VerifyHexParser(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("hex parser mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.outputVerifyMode)
+        {
+            // --outv 5A --e 00
+            uint32_t mismatches = VerifyOutputWriter(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("output writer mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.pcapVerifyMode)
+        {
+            // --pcapv 5A --e 00
+            uint32_t mismatches = VerifyPcap(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("pcap mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.streamVerifyMode)
+        {
+            // --streamv 5A --e 00
+            uint32_t mismatches = VerifyStream(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("stream mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.batchVerifyMode)
+        {
+            // --batchv 5A --e 00
+            uint32_t mismatches = VerifyBatch(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("batch mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.packetVerifyMode)
+        {
+            // --pktv 5A --e 00
+            uint32_t mismatches = VerifyPacketDecoder(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("packet decoder mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.fec13Mode)
+        {
+            // --f13 60 EF 8F 1F C0 0E 00 08 --e 10 D0 00 03
+            // 7 byte FEC 1/3 coded headers in, dewhitened header and split vote count per header out
+            size_t headerCount = ctx.testData.size() / BluetoothFec13::CODED_BYTES;
+            std::vector<uint8_t> headers(headerCount * BluetoothFec13::HEADER_BYTES);
+            std::vector<uint32_t> unanimous(headerCount);
+            BluetoothFec13::Decode(ctx.testData.data(), headerCount, headers.data(), unanimous.data());
+
+            BluetoothWhitening whitening(ctx.seed);
+            ctx.dataOut.clear();
+            for (size_t i = 0; i < headerCount; i++)
+            {
+                uint8_t* header = &headers[i * BluetoothFec13::HEADER_BYTES];
+                whitening.WhitenData(header, BluetoothFec13::HEADER_BYTES);
+                uint32_t splitBits = 0;
+                for (uint32_t bit = 0; bit < BluetoothFec13::HEADER_BITS; bit++)
                 {
-                    printf("%u", (fecData[i / 8] >> (i & 7)) & 1);
+                    splitBits += BluetoothFec13::Votes(unanimous[i], bit) == 3 ? 0 : 1;
                 }
-                printf(" ");
-                for (int i = 0; i < 5; i++)
+                if (perRecord)
                 {
-                    printf("%u", (parity >> i) & 1);
+                    out.Text("header ");
+                    out.HexBytes(header, BluetoothFec13::HEADER_BYTES);
+                    out.Text("split votes ");
+                    out.Decimal(splitBits);
+                    out.Char('\n');
                 }
-                printf("\n");
-                dataOut.push_back(parity);
+                ctx.dataOut.insert(ctx.dataOut.end(), header, header + BluetoothFec13::HEADER_BYTES);
+                ctx.dataOut.push_back(splitBits & 0xFF);
+            }
+            if (perRecord == false)
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.fec13VerifyMode)
+        {
+            // --f13v 5A --e 00
+            uint32_t mismatches = VerifyFec13(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("fec 1/3 mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.fecVerifyMode)
+        {
+            // --fv 5A --e 00
+            uint32_t mismatches = VerifyFec23(ctx.seed);
+            ctx.dataOut.clear();
+            ctx.dataOut.push_back(mismatches != 0 ? 1 : 0);
+            if (perRecord)
+            {
+                printf("fec 2/3 mismatches %u\n", mismatches);
+            }
+            else
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.noAllocMode)
+        {
+            // --z 60 10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09
+            // whitens in place and span to span, any heap allocation fails the test
+            ctx.dataOut = ctx.testData;
+            std::vector<uint8_t> spanOut(ctx.testData.size());
+            BluetoothWhitening whitening(ctx.seed);
+
+#ifdef BTWHITE_ALLOCATION_COUNT
+            size_t allocationsBefore = heapAllocationCount.load();
+#endif
+            whitening.WhitenData(ctx.dataOut.data(), ctx.dataOut.size());
+            whitening.WhitenData(ctx.testData.data(), ctx.testData.size(), spanOut.data(), spanOut.size());
+            whitening.WhitenPayload(ctx.testData.data() + 3, spanOut.data() + 3, ctx.testData.size() - 3);
+#ifdef BTWHITE_ALLOCATION_COUNT
+            size_t allocations = heapAllocationCount.load() - allocationsBefore;
+            if (perRecord)
+            {
+                printf("heap allocations %zu\n", allocations);
+            }
+#else
+            // allocations are only counted in btwhite_test
+            size_t allocations = 0;
+            if (perRecord)
+            {
+                printf("heap allocations not counted in this build\n");
+            }
+#endif
+            if (allocations != 0 || spanOut != ctx.dataOut)
+            {
+                ctx.dataOut.clear();
             }
+            if (perRecord == false)
+            {
+                WriteResult(ctx, ctx.dataOut, out);
+            }
+        }
+        else if (ctx.bitsMode)
+        {
+            // --w [--bo ctx.bitOffset] [--bl ctx.bitLength] 60 10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09
+            // packed bit stream, payload directly after the 18 header bits
+            size_t availableBits = ctx.testData.size() * 8;
+            size_t whitenBits = availableBits > ctx.bitOffset ? availableBits - ctx.bitOffset : 0;
+            if (ctx.bitLength != 0 && ctx.bitLength < whitenBits)
+            {
+                whitenBits = ctx.bitLength;
+            }
+            ctx.dataOut = ctx.testData;
+            BluetoothWhitening whitening(ctx.seed);
+            whitening.WhitenBits(ctx.dataOut.data(), ctx.bitOffset, whitenBits);
+
+            WriteResult(ctx, ctx.dataOut, out);
+        }
+        else if (ctx.payloadMode)
+        {
+            // --p 60 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09
+            BluetoothWhitening whitening(ctx.seed);
+            whitening.WhitenPayload(ctx.testData, ctx.dataOut);
+
+            WriteResult(ctx, ctx.dataOut, out);
         }
         else
         {
             //60 10 D0 00 C1 9E 81 3F AB 74 72 97 86 5D 64 0C 01 2A C2 CB E7 09
             //   6F 0C 00 8B C1 04 C9 37 EE B4 41 43 19 44 55 DF CB 4D D0 42 A6
-            BluetoothWhitening whitening(seed);
-            whitening.WhitenData(testData, dataOut);
+            BluetoothWhitening whitening(ctx.seed);
+            whitening.WhitenData(ctx.testData, ctx.dataOut);
 
-            for (size_t i = 0; i < dataOut.size(); i++)
-            {
-                printf("%02X ", dataOut[i]);
-            }
-            printf("\n");
+            WriteResult(ctx, ctx.dataOut, out);
         }
-        if (testResults)
+        out.Flush();
+        if (ctx.testResults)
         {
             uint32_t dataMatch = 0;
             uint32_t dataFail = 0;
             uint32_t dataTotal = 0;
-            if (dataOut.size() != expectedData.size())
+            if (ctx.dataOut.size() != ctx.expectedData.size())
             {
-                printf("Size mismatch in dataOut! Expected %4zu Actual %4zu\n", expectedData.size(), dataOut.size());
+                printf("Size mismatch in ctx.dataOut! Expected %4zu Actual %4zu\n", ctx.expectedData.size(), ctx.dataOut.size());
                 dataFail++;
             }
 
-            for (size_t i = 0; i < expectedData.size(); i++)
+            for (size_t i = 0; i < ctx.expectedData.size(); i++)
             {
                 dataTotal++;
-                if (dataOut.size() >= i)
+                if (ctx.dataOut.size() >= i)
                 {
-                    if (expectedData[i] == dataOut[i])
+                    if (ctx.expectedData[i] == ctx.dataOut[i])
                     {
                         dataMatch++;
                     }
                     else
                     {
-                        printf("Mismatch in dataOut at index %4zu! Expected %02X Actual %02X\n", i, expectedData[i], dataOut[i]);
+                        printf("Mismatch in ctx.dataOut at index %4zu! Expected %02X Actual %02X\n", i, ctx.expectedData[i], ctx.dataOut[i]);
                         dataFail++;
                     }
                 }
             }
+            // with --q and --bin the result is all a mode writes
+            if (ctx.verbosity == Verbosity::Quiet && ctx.outputFile.empty())
+            {
+                uint64_t resultSize = ctx.binaryOutput ? ctx.dataOut.size() : ctx.dataOut.size() * 3 + 1;
+                if (out.Written() != resultSize)
+                {
+                    printf("Output size mismatch! Expected %4llu Actual %4llu\n", static_cast<unsigned long long>(resultSize), static_cast<unsigned long long>(out.Written()));
+                    dataFail++;
+                }
+            }
             printf("Matched %4u of %4u failed %4u, test %s\n", dataMatch, dataTotal, dataFail, dataFail == 0 ? "Passed" : "Failed");
             unitTestPassed += dataFail == 0 ? 1 : 0;
         }
         unitTestIndex++;
     }
-    if (testResults)
+    if (ctx.testResults)
     {
         printf("\nPassed %4u of %4u tests! Unittest complete!\n", unitTestPassed, unitTestIndex);
     }
@@ -1,3 +1,3 @@
-g++ LinearFeedbackShiftRegister.cpp bluetoothWhitening.cpp -o btwhite
-g++ bluetoothChannelHopping.cpp -o bthop
-
+g++ -O2 -pthread LinearFeedbackShiftRegister.cpp bluetoothWhitening.cpp -o btwhite
+g++ -O2 -pthread -DBTWHITE_ALLOCATION_COUNT LinearFeedbackShiftRegister.cpp bluetoothWhitening.cpp -o btwhite_test
+g++ -O2 bluetoothChannelHopping.cpp -o bthop